@@ -0,0 +1,167 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ____________________________*AutoTuner* : Index parameter tuning____________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    AutoTuner.h picks the IndexParams (leaf size, number of trees, search budget) of an index for a
+    dataset, by measuring instead of guessing.
+
+    - Structures:
+
+        - TuneGrid:
+            Description:
+                The values tried for every parameter. Every combination is tried.
+
+    - Functions:
+
+        - vector<vector<int>> exactNeighbours(const vector<DataVector>& points, const vector<DataVector>& queries, int k):
+            Description:
+                The ids of the k true nearest points of every query, from BruteForceIndex.
+
+        - IndexParams autotune(TreeIndex& index, const vector<DataVector>& sample,
+                               const vector<DataVector>& queries, int k, double targetRecall,
+                               const TuneGrid& grid, ostream& log):
+            Description:
+                Sweep grid on index, built over sample and queried with queries.
+
+            Function Explanation:
+                - Computes the exact neighbours of the queries once.
+                - Starts every combination from the current parameters of index, so its storage,
+                  threads, memory budget and the rest are kept; only leafSize, numTrees and
+                  searchBudget vary.
+                - Builds the index once per (leafSize, numTrees); the search budget needs no rebuild.
+                - For every combination measures recall@k (the fraction of the true k nearest that
+                  knn() returns) and the mean query time, and writes one line per combination to log.
+                - Returns the fastest combination whose recall reaches targetRecall, or the one with
+                  the best recall if none does. The index is left configured with the result, and
+                  IndexParams::save() writes it out for reuse.
+*/
+
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include "DataVector.h"
+#include "TreeIndex.h"
+#include "BruteForceIndex.h"
+
+using namespace std;
+
+struct TuneGrid
+{
+    vector<int> leafSizes;
+    vector<int> treeCounts;
+    vector<int> budgets; // 0 means no limit
+
+    TuneGrid()
+    {
+        int leaves[] = {2, 4, 8, 16, 32, 64, 128};
+        int trees[] = {1, 2, 4, 8};
+        int limits[] = {0, 64, 256, 1024, 4096};
+        leafSizes.assign(leaves, leaves + 7);
+        treeCounts.assign(trees, trees + 4);
+        budgets.assign(limits, limits + 5);
+    }
+};
+
+inline vector<vector<int>> exactNeighbours(const vector<DataVector> &points, const vector<DataVector> &queries, int k)
+{
+    BruteForceIndex exact;
+    exact.maketree(points);
+    vector<vector<pair<double, int>>> nearest = exact.batch_knn(queries, k);
+
+    vector<vector<int>> truth(queries.size());
+    for (size_t q = 0; q < queries.size(); q++)
+    {
+        for (size_t i = 0; i < nearest[q].size(); i++)
+        {
+            truth[q].push_back(nearest[q][i].second);
+        }
+    }
+    return truth;
+}
+
+inline IndexParams autotune(TreeIndex &index, const vector<DataVector> &sample, const vector<DataVector> &queries,
+                            int k, double targetRecall, const TuneGrid &grid, ostream &log)
+{
+    vector<vector<int>> truth = exactNeighbours(sample, queries, k);
+    IndexParams base = index.getParams();
+
+    IndexParams best = base;
+    double bestRecall = -1, bestTime = 0;
+    bool bestMeetsTarget = false;
+
+    for (size_t l = 0; l < grid.leafSizes.size(); l++)
+    {
+        for (size_t t = 0; t < grid.treeCounts.size(); t++)
+        {
+            IndexParams params = base;
+            params.leafSize = grid.leafSizes[l];
+            params.numTrees = grid.treeCounts[t];
+            index.setParams(params);
+            if (!index.maketree(sample))
+            {
+                log << "leafSize=" << params.leafSize << " numTrees=" << params.numTrees
+                    << " does not fit in the memory budget" << endl;
+                continue;
+            }
+
+            for (size_t b = 0; b < grid.budgets.size(); b++)
+            {
+                params.searchBudget = grid.budgets[b];
+                index.setParams(params);
+
+                int found = 0;
+                auto start = chrono::high_resolution_clock::now();
+                for (size_t q = 0; q < queries.size(); q++)
+                {
+                    vector<pair<double, int>> result = index.knn(queries[q], k);
+                    for (size_t i = 0; i < result.size(); i++)
+                    {
+                        found += count(truth[q].begin(), truth[q].end(), result[i].second);
+                    }
+                }
+                auto stop = chrono::high_resolution_clock::now();
+
+                double micros = chrono::duration<double, micro>(stop - start).count() / max((size_t)1, queries.size());
+                double recall = (double)found / max((size_t)1, queries.size() * k);
+                log << "leafSize=" << params.leafSize << " numTrees=" << params.numTrees
+                    << " searchBudget=" << params.searchBudget << " recall=" << recall
+                    << " microseconds/query=" << micros << endl;
+
+                bool meetsTarget = recall >= targetRecall;
+                bool better;
+                if (meetsTarget != bestMeetsTarget)
+                    better = meetsTarget;
+                else if (meetsTarget)
+                    better = micros < bestTime;
+                else
+                    better = recall > bestRecall || (recall == bestRecall && micros < bestTime);
+
+                if (bestRecall < 0 || better)
+                {
+                    best = params;
+                    bestRecall = recall;
+                    bestTime = micros;
+                    bestMeetsTarget = meetsTarget;
+                }
+            }
+        }
+    }
+
+    if (!bestMeetsTarget)
+    {
+        log << "No configuration reaches recall " << targetRecall << ", using the most accurate one" << endl;
+    }
+    log << "Chosen: leafSize=" << best.leafSize << " numTrees=" << best.numTrees
+        << " searchBudget=" << best.searchBudget << " recall=" << bestRecall
+        << " microseconds/query=" << bestTime << endl;
+
+    index.setParams(best);
+    return best;
+}
+
+#endif
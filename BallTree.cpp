@@ -0,0 +1,119 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <chrono>
+#include "BallTreeIndex.h"
+#include "VectorDataset.h"
+#include "QueryCache.h"
+#include "ResultSink.h"
+#include "DataVector.h"
+
+using namespace std;
+using namespace chrono;
+
+// Usage: balltree [config]
+// config is an IndexParams file, e.g. one written by autotune.
+// The answers of the batch over every test vector go to <output>.ivecs/.fvecs or <output>.csv with
+// resultFormat=vecs or csv in config; printVectors=1 prints the coordinates of the neighbours found.
+int main(int argc, char *argv[])
+{
+    traceFromEnvironment();
+    IndexParams params;
+    if (argc > 1 && !params.load(argv[1]))
+    {
+        return 1;
+    }
+
+    string testfilename = "";
+    cout<<"Enter only the test filename (location) in a line:\n";
+    cin>>testfilename;
+
+    string trainfilename = "";
+    cout<<"Enter only the train filename (location) in a line:\n";
+    cin>>trainfilename;
+
+    int k = 5;
+    cout<<"Enter the value of k:\n";
+    cin>>k;
+
+    string outfile;
+    cout<<"Enter only the output filename (location) in a line:\n";
+    cin>>outfile;
+    ofstream file(outfile, ios::app);
+    if (file.is_open()) {
+    } else {
+        cout << "Unable to open file" << endl;
+    }
+    
+    VectorDataset test;
+    test.readCSV(testfilename);
+    VectorDataset train;
+    train.readCSV(trainfilename);
+    
+    vector<DataVector> myData = train.getDataset();
+
+    BallTreeIndex engine(params);
+    CachedIndex index(engine, params);
+    if (!admitBuild(index.estimateMemory(myData.size(), myData.empty() ? 0 : myData[0].getDimension()), params))
+    {
+        return 1;
+    }
+    index.maketree(myData);
+
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < 2; i++) {
+        file<<"index of vector: "<<i<<endl;
+        auto start2 = high_resolution_clock::now();
+        vector<DataVector> smallset = index.query_search(test.getDataset()[i], k);
+
+        VectorDataset smalldataset;
+        smalldataset.setDataset(smallset);
+
+        VectorDataset d = test.knearestneighbor(i, k, smalldataset);
+        auto stop2 = high_resolution_clock::now();
+        auto duration2 = duration_cast<milliseconds>(stop2 - start2);
+        if (params.printVectors)
+        {
+            TraceSpan span("output");
+            cout << "Neighbour of vector: " << i << endl;
+            d.printDataset();
+        }
+        file << "Time taken to calculate nearest neighbors: " << duration2.count() << " milliseconds\n\n";
+    }
+    // every test vector at once, through the batched path
+    auto start3 = high_resolution_clock::now();
+    vector<vector<pair<double, int>>> batch = index.batch_knn(test.getDataset(), k);
+    auto stop3 = high_resolution_clock::now();
+    auto duration3 = duration_cast<milliseconds>(stop3 - start3);
+    file << "Time taken to calculate nearest neighbors of all " << batch.size() << " test vectors in one batch: " << duration3.count() << " milliseconds\n\n";
+    if (params.resultFormat != RESULT_NONE)
+    {
+        ResultSink sink;
+        if (sink.open(outfile, params.resultFormat))
+        {
+            for (size_t q = 0; q < batch.size(); q++)
+            {
+                sink.write(q, batch[q]);
+            }
+            sink.close();
+            file << "Answers of the batch written to " << outfile << (params.resultFormat == RESULT_VECS ? ".ivecs/.fvecs" : ".csv") << "\n\n";
+        }
+    }
+    if (params.cacheSize > 0)
+    {
+        file << "Query cache: " << index.hits() << " hits, " << index.misses() << " misses\n\n";
+    }
+    file.close();
+
+    auto stop = high_resolution_clock::now();
+    auto duration = duration_cast<milliseconds>(stop - start);
+    
+    cout << "\nTotal time taken to calculate nearest neighbors: " << duration.count() << " milliseconds\n\n";
+
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,452 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    _________________________*BallTreeIndex* : The BallTreeIndex class_________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    BallTreeIndex.h contains the ball tree index. Every node stores the centroid of its points and the
+    radius of the smallest ball around the centroid holding them all. An internal node splits its
+    points in two along the direction joining two far-apart points of the node (the farthest point
+    from the centroid, and the farthest point from that one), at the median projection; leaves hold
+    at most IndexParams::leafSize points.
+
+    A query walks the tree nearer ball first, keeping its k best so far, and prunes with the triangle
+    inequality only:
+        - a node whose ball is farther than the k-th best, |q - c| - r >= kth, is skipped;
+        - in a leaf, a point x whose distance to the leaf's centroid c is known is skipped when
+          | |q - c| - |x - c| | >= kth, without computing |q - x|.
+    Unlike the plane tests of KDTreeIndex and RPTreeIndex these bounds stay tight when the points of a
+    node are spread over many dimensions. The search only compares distances, so its pruning holds
+    for any metric; the distances are those of the VectorStore (L2).
+
+    Once k candidates are kept, a query scans at most IndexParams::searchBudget more rows (0 for no
+    limit). The tree keeps its points in one flat buffer (TreePoints) laid out in tree order, so a
+    node only stores the row range of its points; nodes and centroids come from the tree's NodeArenas.
+
+    With point attributes attached (setAttributes), every node keeps the AttributeSummary of its
+    points, and filtered_knn runs the same search, skipping the balls whose summary rules the filter
+    out and testing the filter on every point of a leaf before scoring it.
+
+    The built tree (BallTree) is immutable and published through a Snapshot, so queries run
+    concurrently with AddData / DeleteData and never wait for a build (see the concurrency model in
+    TreeIndex.h).
+*/
+
+#ifndef BALLTREEINDEX_H
+#define BALLTREEINDEX_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include "DataVector.h"
+#include "TreeIndex.h"
+#include "NodeArena.h"
+#include "DistanceKernels.h"
+#include "BatchQuery.h"
+
+using namespace std;
+
+struct BallNode
+{
+    BallNode* left;
+    BallNode* right;
+    const double* centre;
+    double radius;  // largest distance of a point under this node to centre
+    int begin, end; // rows of the tree's points under this node
+    AttributeSummary summary; // of the points under this node, with attributes
+};
+
+// A fully built ball tree. Never modified once published.
+struct BallTree
+{
+    TreePoints points;
+    NodeArena<BallNode> nodes;
+    NodeArena<double> centres;
+    BallNode* root;
+    vector<double> spread; // spread[i]: distance of row i to the centre of its leaf
+    int leafSize;
+    shared_ptr<const PointAttributes> attributes; // those the node summaries were built from
+
+    BallTree() : centres(1 << 16), root(NULL), leafSize(MINSIZE) {}
+};
+
+class BallTreeIndex : public TreeIndex
+{
+    Snapshot<BallTree> snapshot;
+    mutable mutex writer;
+    shared_ptr<BallTree> published, retired;
+    IndexParams params;
+    atomic<int> searchBudget;
+    atomic<int> threads;
+
+    // initial call to build tree
+    static void buildTree(BallTree &tree, const vector<DataVector>& points, const IndexParams &params)
+    {
+        TraceSpan span("ball.build");
+        tree.nodes.reset();
+        tree.centres.reset();
+        tree.nodes.setHugePages(params.hugePages);
+        tree.centres.setHugePages(params.hugePages);
+        tree.points.setHugePages(params.hugePages);
+        tree.root = NULL;
+        tree.leafSize = max(2, params.leafSize);
+        tree.points.load(points);
+        tree.spread.assign(points.size(), 0);
+        if (points.empty())
+        {
+            return;
+        }
+
+        vector<int> order(points.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        vector<pair<double, int>> keys(points.size());
+        tree.root = buildTree(tree, order, keys, 0, order.size());
+        // lay the rows out in tree order, so every node's points are contiguous
+        tree.points.permute(order);
+        if (tree.attributes)
+        {
+            summarize(tree, tree.root);
+        }
+        TraceSpan finish("ball.finish");
+        tree.points.finish(params.storage, params.rerank, params.pqSubspaces, params.varianceOrder);
+    }
+
+    // Fill in the attribute summaries of node and its subtree.
+    static const AttributeSummary &summarize(BallTree &tree, BallNode *node)
+    {
+        node->summary = AttributeSummary();
+        if (node->left == NULL)
+        {
+            for (int i = node->begin; i < node->end; i++)
+            {
+                node->summary.add(tree.attributes->summary(tree.points.ids[i]));
+            }
+        }
+        else
+        {
+            node->summary.add(summarize(tree, node->left));
+            node->summary.add(summarize(tree, node->right));
+        }
+        return node->summary;
+    }
+
+    // Overloaded buildTree function for a range of order (actual implementation). keys is scratch
+    // space of the same length as order.
+    static BallNode *buildTree(BallTree &tree, vector<int> &order, vector<pair<double, int>> &keys, int begin, int end)
+    {
+        const TreePoints &points = tree.points;
+        int dim = points.dim;
+
+        BallNode *newnode = tree.nodes.allocate();
+        newnode->begin = begin;
+        newnode->end = end;
+        newnode->left = NULL;
+        newnode->right = NULL;
+
+        // centroid and radius of the ball
+        double *centre = tree.centres.allocate(dim);
+        fill(centre, centre + dim, 0.0);
+        for (int it = begin; it != end; it++)
+        {
+            const double *p = points.row(order[it]);
+            for (int i = 0; i < dim; i++)
+                centre[i] += p[i];
+        }
+        for (int i = 0; i < dim; i++)
+        {
+            centre[i] /= end - begin;
+        }
+        newnode->centre = centre;
+
+        const double *far = points.row(order[begin]);
+        double radius2 = 0;
+        for (int it = begin; it != end; it++)
+        {
+            const double *p = points.row(order[it]);
+            double dist2 = squaredDistance(p, centre, dim);
+            if (dist2 > radius2)
+            {
+                radius2 = dist2;
+                far = p;
+            }
+        }
+        newnode->radius = sqrt(radius2);
+
+        if (end - begin <= tree.leafSize || radius2 == 0)
+        {
+            // the distances to the leaf's centre, by position, which is the row once permuted
+            for (int it = begin; it != end; it++)
+            {
+                tree.spread[it] = sqrt(squaredDistance(points.row(order[it]), centre, dim));
+            }
+            return newnode;
+        }
+
+        // the farthest point from far: far and other are about as far apart as any two points
+        const double *other = far;
+        double maxdist = 0;
+        for (int it = begin; it != end; it++)
+        {
+            const double *p = points.row(order[it]);
+            double dist2 = squaredDistance(p, far, dim);
+            if (dist2 > maxdist)
+            {
+                maxdist = dist2;
+                other = p;
+            }
+        }
+
+        // split at the median projection on other - far; neither half has to be sorted
+        vector<double> direction(dim);
+        for (int i = 0; i < dim; i++)
+        {
+            direction[i] = other[i] - far[i];
+        }
+        for (int it = begin; it != end; it++)
+        {
+            keys[it] = make_pair(dotProduct(points.row(order[it]), direction.data(), dim), order[it]);
+        }
+        int median = begin + (end - begin) / 2;
+        nth_element(keys.begin() + begin, keys.begin() + median, keys.begin() + end);
+        for (int it = begin; it != end; it++)
+        {
+            order[it] = keys[it].second;
+        }
+
+        newnode->left = buildTree(tree, order, keys, begin, median);
+        newnode->right = buildTree(tree, order, keys, median, end);
+        return newnode;
+    }
+
+    // Adds the rows under node that can be among the k nearest to result, nearer ball first. gap is
+    // |query - centre of node|. rows receives every row scored, if not NULL. Once result is full, no
+    // more than budget rows (0 for no limit) are scored. With a filter, only the rows that match it
+    // are, and a node whose summary rules it out is skipped.
+    static void search(const BallTree &tree, const StoreQuery &query, const BallNode *node, double gap, TopK &result,
+                       vector<int> *rows, int &scanned, int budget, const PointFilter *filter)
+    {
+        if (filter != NULL && !filter->mayMatch(node->summary))
+        {
+            return;
+        }
+        const TreePoints &points = tree.points;
+        if (node->left == NULL)
+        {
+            for (int i = node->begin; i < node->end; i++)
+            {
+                if (filter != NULL && !filter->matches(*tree.attributes, points.ids[i]))
+                    continue;
+                double bound = result.full() ? result.worst() : numeric_limits<double>::infinity();
+                double lower = gap - tree.spread[i];
+                if (lower * lower >= bound)
+                    continue;
+                result.push(points.store.squaredDistance(query, i, bound), i);
+                if (rows != NULL)
+                    rows->push_back(i);
+                scanned++;
+            }
+            return;
+        }
+
+        int dim = points.dim;
+        const BallNode *child[2] = {node->left, node->right};
+        double gaps[2] = {sqrt(squaredDistance(query.f64, node->left->centre, dim)),
+                          sqrt(squaredDistance(query.f64, node->right->centre, dim))};
+        int first = gaps[0] <= gaps[1] ? 0 : 1;
+        for (int c = 0; c < 2; c++)
+        {
+            int i = c == 0 ? first : 1 - first;
+            double lower = max(0.0, gaps[i] - child[i]->radius);
+            bool affordable = budget <= 0 || scanned < budget;
+            if (!result.full() || (lower * lower < result.worst() && affordable))
+            {
+                search(tree, query, child[i], gaps[i], result, rows, scanned, budget, filter);
+            }
+        }
+    }
+
+    // The k nearest rows to point, as (squared distance, row) pairs in no particular order; only
+    // among the rows that match filter, if not NULL.
+    vector<pair<double, int>> nearestRows(const BallTree &tree, const double *point, int k, vector<int> *rows,
+                                          const PointFilter *filter = NULL) const
+    {
+        TraceSpan span("ball.search");
+        StoreQuery query = tree.points.store.prepare(point);
+        TopK result(tree.points.keep(k));
+        int scanned = 0;
+        double gap = sqrt(squaredDistance(point, tree.root->centre, tree.points.dim));
+        search(tree, query, tree.root, gap, result, rows, scanned, searchBudget, filter);
+        return result.items();
+    }
+
+    // Upper bound of the memory of a build over n points of dimension dim (see TreeIndex::estimateMemory).
+    static MemoryEstimate estimate(size_t n, int dim, const IndexParams &params)
+    {
+        MemoryEstimate memory = TreePoints::estimate(n, dim, params);
+        // every node has a centre, every row a spread
+        memory.nodes = treeNodes(n, max(2, params.leafSize)) * (sizeof(BallNode) + dim * sizeof(double)) + n * sizeof(double) +
+                       hugePageSlack(params, 2);
+        memory.ids += n * (sizeof(int) + sizeof(pair<double, int>));
+        return memory;
+    }
+
+    // Build a tree over points off to the side and make it the current version, unless it does not
+    // fit in the memory budget, in which case it returns false.
+    bool rebuild(const vector<DataVector> &points)
+    {
+        if (!admitBuild(estimate(points.size(), points.empty() ? 0 : points[0].getDimension(), params), params))
+        {
+            return false;
+        }
+        // Recycle the tree retired by the previous update if no reader holds it any more: it is no
+        // longer published, so nobody can pin it again, and resetting its arenas frees every node at once.
+        shared_ptr<BallTree> tree;
+        if (retired && retired.use_count() == 1)
+        {
+            atomic_thread_fence(memory_order_acquire);
+            tree.swap(retired);
+        }
+        else
+        {
+            tree = make_shared<BallTree>();
+        }
+        retired.reset();
+
+        tree->attributes = pinAttributes();
+        buildTree(*tree, points, params);
+        snapshot.publish(tree);
+
+        retired = published;
+        published = tree;
+        return true;
+    }
+
+public:
+    BallTreeIndex(const IndexParams &params = IndexParams())
+        : params(params), searchBudget(params.searchBudget), threads(params.threads) {}
+
+    // The candidates are the rows the search scored: the ones the triangle inequality could not
+    // rule out.
+    vector<DataVector> query_search(const DataVector &point, int k) const
+    {
+        shared_ptr<const BallTree> tree = snapshot.pin();
+        if (!tree || tree->root == NULL)
+        {
+            return vector<DataVector>();
+        }
+        vector<double> query = point.getVector();
+        vector<int> rows;
+        nearestRows(*tree, query.data(), k, &rows);
+
+        vector<DataVector> candidates;
+        candidates.reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            candidates.push_back(tree->points.get(rows[i]));
+        }
+        return candidates;
+    }
+
+    vector<pair<double, int>> knn(const DataVector &point, int k) const
+    {
+        shared_ptr<const BallTree> tree = snapshot.pin();
+        if (!tree || tree->root == NULL)
+        {
+            return vector<pair<double, int>>();
+        }
+        vector<double> query = point.getVector();
+        return tree->points.answer(query.data(), nearestRows(*tree, query.data(), k, NULL), k);
+    }
+
+    // Falls back to the over-fetching TreeIndex::filtered_knn when the tree was built without the
+    // attributes attached now.
+    vector<pair<double, int>> filtered_knn(const DataVector &point, int k, const PointFilter &filter) const
+    {
+        shared_ptr<const BallTree> tree = snapshot.pin();
+        if (!tree || tree->root == NULL)
+        {
+            return vector<pair<double, int>>();
+        }
+        if (!tree->attributes || tree->attributes != pinAttributes())
+        {
+            return TreeIndex::filtered_knn(point, k, filter);
+        }
+        vector<double> query = point.getVector();
+        return tree->points.answer(query.data(), nearestRows(*tree, query.data(), k, NULL, &filter), k);
+    }
+
+    // One search per query, the queries spread over IndexParams::threads workers.
+    vector<vector<pair<double, int>>> batch_knn(const vector<DataVector> &queries, int k) const
+    {
+        vector<vector<pair<double, int>>> answers(queries.size());
+        shared_ptr<const BallTree> tree = snapshot.pin();
+        if (!tree || tree->root == NULL)
+        {
+            return answers;
+        }
+        parallelFor(queries.size(), threads, [&](int q, int) {
+            vector<double> query = queries[q].getVector();
+            answers[q] = tree->points.answer(query.data(), nearestRows(*tree, query.data(), k, NULL), k);
+        });
+        return answers;
+    }
+
+    void setParams(const IndexParams &newparams)
+    {
+        lock_guard<mutex> lock(writer);
+        params = newparams;
+        searchBudget = newparams.searchBudget;
+        threads = newparams.threads;
+    }
+
+    IndexParams getParams() const
+    {
+        lock_guard<mutex> lock(writer);
+        return params;
+    }
+
+    MemoryEstimate estimateMemory(size_t points, int dim) const
+    {
+        lock_guard<mutex> lock(writer);
+        return estimate(points, dim, params);
+    }
+
+    bool maketree(const vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        return rebuild(points);
+    }
+
+    //AddData
+    bool AddData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size() + 1, newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        points.push_back(newpoint);
+        return rebuild(points);
+    }
+
+    //DeleteData
+    bool DeleteData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size(), newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        points.erase(remove(points.begin(), points.end(), newpoint), points.end());
+        return rebuild(points);
+    }
+};
+
+#endif
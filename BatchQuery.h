@@ -0,0 +1,198 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ______________________________*BatchQuery* : Batched leaf scans______________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    BatchQuery.h contains the parts of batch_knn shared by the tree indexes.
+
+    A batch is answered in two rounds. In each round the index first routes every query through the
+    tree (comparisons only) and emits a ScanJob for every range of points the query has to look at:
+    its own leaf in the first round, the sibling subtrees that can still hold a closer point in the
+    second. runScanJobs() then groups the jobs by range, so every range is read once for all the
+    queries that need it, and computes each group as a blocked distance product.
+
+    - Structures:
+
+        - TopK:
+            Description:
+                The k best (squared distance, row) pairs found so far for one query, as a max-heap.
+                A point reached twice (e.g. through two trees of a forest) is kept once.
+                TreePoints::answer() turns them into the final (distance, id) answer.
+
+        - ScanJob:
+            Description:
+                Scan the points [begin, end) of a tree for one query. order maps positions to rows
+                for trees whose order is not the row order (NULL or empty otherwise).
+
+    - Functions:
+
+        - void runScanJobs(const TreePoints& points, const TreePoints& queries,
+                           vector<ScanJob>& jobs, vector<TopK>& results):
+            Description:
+                Run every job, adding the scanned points to results[job.query]. Sorts jobs. The
+                rows are read from points.store (decoded once per block for compact modes), the
+                queries from queries.data.
+*/
+
+#ifndef BATCHQUERY_H
+#define BATCHQUERY_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "TreeIndex.h"
+#include "DistanceKernels.h"
+
+using namespace std;
+
+class TopK
+{
+    int k;
+    vector<pair<double, int>> heap;
+
+public:
+    TopK(int k = 1) : k(k) {}
+
+    bool full() const
+    {
+        return (int)heap.size() >= k;
+    }
+
+    int size() const
+    {
+        return heap.size();
+    }
+
+    // Largest squared distance kept, infinity while empty.
+    double worst() const
+    {
+        return heap.empty() ? numeric_limits<double>::infinity() : heap.front().first;
+    }
+
+    void push(double dist2, int id)
+    {
+        if (k <= 0 || (full() && dist2 >= heap.front().first))
+        {
+            return;
+        }
+        for (size_t i = 0; i < heap.size(); i++)
+        {
+            if (heap[i].second == id)
+            {
+                return;
+            }
+        }
+        if (full())
+        {
+            pop_heap(heap.begin(), heap.end());
+            heap.pop_back();
+        }
+        heap.push_back(make_pair(dist2, id));
+        push_heap(heap.begin(), heap.end());
+    }
+
+    // The (squared distance, row) pairs kept, in no particular order.
+    const vector<pair<double, int>> &items() const
+    {
+        return heap;
+    }
+};
+
+struct ScanJob
+{
+    const vector<int> *order;
+    int begin, end;
+    int query;
+
+    bool operator<(const ScanJob &other) const
+    {
+        if (order != other.order)
+            return order < other.order;
+        if (begin != other.begin)
+            return begin < other.begin;
+        if (end != other.end)
+            return end < other.end;
+        return query < other.query;
+    }
+};
+
+inline void runScanJobs(const TreePoints &points, const TreePoints &queries, vector<ScanJob> &jobs, vector<TopK> &results)
+{
+    // A block of rows (ROWBLOCK x dim) stays in cache while every block of QUERYBLOCK queries of the
+    // group is multiplied against it.
+    const int QUERYBLOCK = 64, ROWBLOCK = 256;
+    int dim = points.dim;
+    TraceSpan span("batch.scan");
+
+    sort(jobs.begin(), jobs.end());
+
+    const VectorStore &store = points.store;
+    vector<double> qtile, qnorms, xtile, xnorms, out;
+    size_t g = 0;
+    while (g < jobs.size())
+    {
+        size_t e = g;
+        while (e < jobs.size() && jobs[e].order == jobs[g].order && jobs[e].begin == jobs[g].begin && jobs[e].end == jobs[g].end)
+        {
+            e++;
+        }
+
+        const vector<int> *order = jobs[g].order;
+        bool contiguous = order == NULL || order->empty();
+
+        for (int x0 = jobs[g].begin; x0 < jobs[g].end; x0 += ROWBLOCK)
+        {
+            int nx = min(ROWBLOCK, jobs[g].end - x0);
+            const double *X, *XN;
+            if (contiguous)
+            {
+                X = store.rows(x0, nx, xtile);
+                XN = &store.norms[x0];
+            }
+            else
+            {
+                // rows of a secondary tree are scattered, pack them once for the whole group
+                xtile.resize((size_t)nx * dim);
+                xnorms.resize(nx);
+                for (int j = 0; j < nx; j++)
+                {
+                    int r = (*order)[x0 + j];
+                    store.decode(r, &xtile[(size_t)j * dim]);
+                    xnorms[j] = store.norms[r];
+                }
+                X = xtile.data();
+                XN = xnorms.data();
+            }
+
+            for (size_t q0 = g; q0 < e; q0 += QUERYBLOCK)
+            {
+                int nq = min((size_t)QUERYBLOCK, e - q0);
+                qtile.resize((size_t)nq * dim);
+                qnorms.resize(nq);
+                for (int i = 0; i < nq; i++)
+                {
+                    int q = jobs[q0 + i].query;
+                    copy(queries.row(q), queries.row(q) + dim, qtile.begin() + (size_t)i * dim);
+                    qnorms[i] = dotProduct(queries.row(q), queries.row(q), dim);
+                }
+
+                out.resize((size_t)nq * nx);
+                blockedSquaredDistances(qtile.data(), qnorms.data(), nq, X, XN, nx, dim, out.data());
+
+                for (int i = 0; i < nq; i++)
+                {
+                    TopK &result = results[jobs[q0 + i].query];
+                    for (int j = 0; j < nx; j++)
+                    {
+                        int r = contiguous ? x0 + j : (*order)[x0 + j];
+                        result.push(out[(size_t)i * nx + j], r);
+                    }
+                }
+            }
+        }
+        g = e;
+    }
+}
+
+#endif
@@ -0,0 +1,313 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ______________________*BruteForceIndex* : The BruteForceIndex class______________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    BruteForceIndex.h contains the exact engine: every query is compared with every point, so its
+    answers are the true k nearest neighbours. It is the recall baseline of the approximate indexes
+    (see AutoTuner.h) and the right choice for small collections.
+
+    The distances of a batch are computed as one blocked matrix product (blockedSquaredDistances,
+    with the norm expansion |q|^2 + |x|^2 - 2 q.x): queries are taken QUERYBLOCK at a time and the
+    points in blocks sized to stay in the L2 cache while every query of the block is compared with
+    them. Every query keeps a TopK heap, so nothing is sorted beyond the k best.
+
+    Work is spread over IndexParams::threads threads by query block and, when there are fewer query
+    blocks than threads, also by slices of the points; the heaps of the slices are merged at the end.
+
+    A single query (knn) has no block to share the rows with, so it scans them one at a time instead,
+    with the early-abandoned distance of VectorStore: a row is dropped as soon as its partial sum
+    exceeds the current k-th best, which skips most of the arithmetic in high dimensions. The slices
+    of the points are scanned in parallel as above. IndexParams::varianceOrder sums the
+    high-variance features first.
+
+    filtered_knn runs the same scan, skipping the points that do not match the filter before any
+    distance is computed, so it is exact and costs less the more selective the filter is.
+
+    The rows are always stored as float64 (IndexParams::storage does not apply): the engine is exact.
+
+    The points (TreePoints) are immutable once published through a Snapshot, so queries run
+    concurrently with AddData / DeleteData and never wait for a build (see the concurrency model in
+    TreeIndex.h).
+*/
+
+#ifndef BRUTEFORCEINDEX_H
+#define BRUTEFORCEINDEX_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include "DataVector.h"
+#include "TreeIndex.h"
+#include "DistanceKernels.h"
+#include "BatchQuery.h"
+
+using namespace std;
+
+class BruteForceIndex : public TreeIndex
+{
+    Snapshot<TreePoints> snapshot;
+    mutable mutex writer;
+    shared_ptr<TreePoints> published, retired;
+    IndexParams params;
+    atomic<int> threads;
+
+    static const int QUERYBLOCK = 64;
+
+    // Rows per block of points: about 256 KB of them, a multiple of the 4-row tile.
+    static int rowBlock(int dim)
+    {
+        return max(64, (32768 / max(1, dim)) & ~3);
+    }
+
+    // Upper bound of the memory of a build over n points of dimension dim (see TreeIndex::estimateMemory).
+    static MemoryEstimate estimate(size_t n, int dim, const IndexParams &params)
+    {
+        MemoryEstimate memory;
+        // float64 rows in the order given, adopted by the store without a copy, and their norms
+        memory.dataset = n * dim * sizeof(double) + n * sizeof(double) + hugePageSlack(params, 1);
+        memory.ids = n * sizeof(int) + hugePageSlack(params, 1);
+        return memory;
+    }
+
+    // Build the points off to the side and make them the current version, unless they do not fit
+    // in the memory budget, in which case it returns false.
+    bool rebuild(const vector<DataVector> &points)
+    {
+        if (!admitBuild(estimate(points.size(), points.empty() ? 0 : points[0].getDimension(), params), params))
+        {
+            return false;
+        }
+        // Recycle the points retired by the previous update if no reader holds them any more (see
+        // KDTreeIndex::rebuild).
+        shared_ptr<TreePoints> flat;
+        if (retired && retired.use_count() == 1)
+        {
+            atomic_thread_fence(memory_order_acquire);
+            flat.swap(retired);
+        }
+        else
+        {
+            flat = make_shared<TreePoints>();
+        }
+        retired.reset();
+
+        flat->setHugePages(params.hugePages);
+        flat->load(points);
+        flat->finish(STORE_FLOAT64, 0, 0, params.varianceOrder);
+        snapshot.publish(flat);
+
+        retired = published;
+        published = flat;
+        return true;
+    }
+
+    // The k nearest points to point, among those matching filter if there is one. Rows are taken one
+    // at a time with the early-abandoned distance, over slices of the points scanned in parallel.
+    vector<pair<double, int>> scan(const DataVector &point, int k, const PointFilter *filter,
+                                   const PointAttributes *attributes) const
+    {
+        shared_ptr<const TreePoints> pinned = snapshot.pin();
+        if (!pinned || pinned->size() == 0)
+        {
+            return vector<pair<double, int>>();
+        }
+        const TreePoints &points = *pinned;
+        int n = points.size();
+        vector<double> values = point.getVector();
+        StoreQuery query = points.store.prepare(values.data());
+
+        TraceSpan span("scan");
+        int rows = rowBlock(points.dim);
+        int slices = max(1, min((n + rows - 1) / rows, workerCount(threads)));
+        vector<TopK> partial(slices, TopK(k));
+        parallelFor(slices, threads, [&](int slice, int) {
+            TopK &result = partial[slice];
+            int first = (long long)n * slice / slices, last = (long long)n * (slice + 1) / slices;
+            for (int x = first; x < last; x++)
+            {
+                // rows are never reordered: the row is the id
+                if (filter != NULL && !filter->matches(*attributes, x))
+                    continue;
+                double bound = result.full() ? result.worst() : numeric_limits<double>::infinity();
+                result.push(points.store.squaredDistance(query, x, bound), x);
+            }
+        });
+
+        for (int s = 1; s < slices; s++)
+        {
+            const vector<pair<double, int>> &items = partial[s].items();
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                partial[0].push(items[i].first, items[i].second);
+            }
+        }
+        return points.answer(values.data(), partial[0].items(), k);
+    }
+
+public:
+    BruteForceIndex(const IndexParams &params = IndexParams()) : params(params), threads(params.threads) {}
+
+    vector<DataVector> query_search(const DataVector &point, int k) const
+    {
+        shared_ptr<const TreePoints> points = snapshot.pin();
+        if (!points)
+        {
+            return vector<DataVector>();
+        }
+        vector<pair<double, int>> nearest = knn(point, k);
+        vector<DataVector> candidates;
+        candidates.reserve(nearest.size());
+        for (size_t i = 0; i < nearest.size(); i++)
+        {
+            // ids are rows: the points are never reordered
+            candidates.push_back(points->get(nearest[i].second));
+        }
+        return candidates;
+    }
+
+    vector<pair<double, int>> knn(const DataVector &point, int k) const
+    {
+        return scan(point, k, NULL, NULL);
+    }
+
+    vector<pair<double, int>> filtered_knn(const DataVector &point, int k, const PointFilter &filter) const
+    {
+        shared_ptr<const PointAttributes> attributes = pinAttributes();
+        if (!attributes)
+        {
+            return vector<pair<double, int>>();
+        }
+        return scan(point, k, &filter, attributes.get());
+    }
+
+    vector<vector<pair<double, int>>> batch_knn(const vector<DataVector> &queries, int k) const
+    {
+        vector<vector<pair<double, int>>> answers(queries.size());
+        shared_ptr<const TreePoints> pinned = snapshot.pin();
+        if (!pinned || pinned->size() == 0 || queries.empty())
+        {
+            return answers;
+        }
+        const TreePoints &points = *pinned;
+        const VectorStore &store = points.store;
+        int dim = points.dim;
+        int n = points.size();
+        int nq = queries.size();
+
+        TreePoints flat;
+        flat.load(queries);
+        vector<double> qnorms(nq);
+        for (int q = 0; q < nq; q++)
+        {
+            qnorms[q] = dotProduct(flat.row(q), flat.row(q), dim);
+        }
+
+        int rows = rowBlock(dim);
+        int queryBlocks = (nq + QUERYBLOCK - 1) / QUERYBLOCK;
+        int rowBlocks = (n + rows - 1) / rows;
+        int workers = workerCount(threads);
+        int slices = max(1, min(rowBlocks, workers / queryBlocks));
+
+        // partial[s][q]: the k best of query q among the points of slice s
+        vector<vector<TopK>> partial(slices, vector<TopK>(nq, TopK(k)));
+        vector<vector<double>> scratch(workers);
+        vector<double> unused; // float64 rows are read in place, so rows() never writes it
+        TraceSpan span("batch.scan");
+
+        parallelFor(queryBlocks * slices, threads, [&](int task, int worker) {
+            int q0 = task / slices * QUERYBLOCK, nqb = min(QUERYBLOCK, nq - q0);
+            int slice = task % slices;
+            vector<double> &out = scratch[worker];
+            out.resize((size_t)QUERYBLOCK * rows);
+            vector<TopK> &results = partial[slice];
+
+            int first = (long long)rowBlocks * slice / slices, last = (long long)rowBlocks * (slice + 1) / slices;
+            for (int x0 = first * rows; x0 < min(n, last * rows); x0 += rows)
+            {
+                int nx = min(rows, n - x0);
+                blockedSquaredDistances(flat.row(q0), &qnorms[q0], nqb, store.rows(x0, nx, unused), &store.norms[x0],
+                                        nx, dim, out.data());
+                for (int i = 0; i < nqb; i++)
+                {
+                    TopK &result = results[q0 + i];
+                    const double *distances = &out[(size_t)i * nx];
+                    for (int j = 0; j < nx; j++)
+                    {
+                        result.push(distances[j], x0 + j);
+                    }
+                }
+            }
+        });
+
+        for (int q = 0; q < nq; q++)
+        {
+            for (int s = 1; s < slices; s++)
+            {
+                const vector<pair<double, int>> &items = partial[s][q].items();
+                for (size_t i = 0; i < items.size(); i++)
+                {
+                    partial[0][q].push(items[i].first, items[i].second);
+                }
+            }
+            answers[q] = points.answer(flat.row(q), partial[0][q].items(), k);
+        }
+        return answers;
+    }
+
+    void setParams(const IndexParams &newparams)
+    {
+        lock_guard<mutex> lock(writer);
+        params = newparams;
+        threads = newparams.threads;
+    }
+
+    IndexParams getParams() const
+    {
+        lock_guard<mutex> lock(writer);
+        return params;
+    }
+
+    MemoryEstimate estimateMemory(size_t points, int dim) const
+    {
+        lock_guard<mutex> lock(writer);
+        return estimate(points, dim, params);
+    }
+
+    bool maketree(const vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        return rebuild(points);
+    }
+
+    //AddData
+    bool AddData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size() + 1, newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        points.push_back(newpoint);
+        return rebuild(points);
+    }
+
+    //DeleteData
+    bool DeleteData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size(), newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        points.erase(remove(points.begin(), points.end(), newpoint), points.end());
+        return rebuild(points);
+    }
+};
+
+#endif
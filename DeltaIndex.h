@@ -0,0 +1,611 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    __________________________*DeltaIndex* : The DeltaIndex class__________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    DeltaIndex.h contains DeltaIndex<Engine>, a TreeIndex for high-rate inserts in the manner of a
+    log-structured merge tree: new points are appended to an unindexed delta segment, and a
+    background thread folds the delta into a new Engine tree once it holds IndexParams::deltaSize
+    points.
+
+    - Ingest (append, AddData) only copies the point into the delta: it never touches a tree and
+      never waits for a build, so bursts of millions of points go in at memory speed.
+    - A query asks the tree, then scans the delta by brute force and merges both answers. The delta
+      is kept in chunks of dimension-major blocks of LEAFBLOCK rows, scored LEAFBLOCK at a time with
+      the vertical distance kernels (blockSquaredDistances).
+    - A fold copies the rows of the delta next to the points of the current tree and builds a new
+      Engine over all of them off to the side. Points appended meanwhile go to a fresh chunk and
+      stay in the delta of the new generation.
+    - While a fold runs or is due, appends wait once the delta holds DELTABACKLOG times deltaSize
+      points, so the delta a query scans stays bounded even when ingest outruns the builds, or one
+      append brings many more points than that.
+    - DeleteData folds the delta at once, without the deleted point. When the fold does not fit in
+      the memory budget, it returns false and leaves the caller's points as they are.
+
+    Ids are positions in the points given to maketree followed by the points appended since, in the
+    order they were appended; a fold keeps them, as it appends the delta after the tree's points.
+
+    The tree of a generation and its delta are published together through a Snapshot (see
+    TreeIndex.h), so a query never sees a point twice, or not at all, while a new tree is swapped in.
+    maketree replaces every point, including the ones appended while it runs.
+
+    - Member Functions (besides the TreeIndex ones):
+
+        - void append(const vector<DataVector>& points), void append(const DataVector& point):
+            Description:
+                Add points to the delta, in order. Safe to call from any number of threads, also
+                while queries and a fold run.
+
+        - bool flush():
+            Description:
+                Fold the whole delta into a new tree now, and wait for it. false if the build does
+                not fit in the memory budget; the delta then stays as it is.
+
+        - size_t pending() const:
+            Description:
+                Number of points in the delta.
+
+    - Functions:
+
+        - TreeIndex* makeDeltaIndex<Engine>(const IndexParams& params):
+            Description:
+                makeIndex<Engine>(params) (see ShardedIndex.h), behind a delta segment if
+                params.deltaSize is more than 0. The caller owns it.
+*/
+
+#ifndef DELTAINDEX_H
+#define DELTAINDEX_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include "DataVector.h"
+#include "TreeIndex.h"
+#include "DistanceKernels.h"
+#include "ShardedIndex.h"
+
+using namespace std;
+
+// Bytes of rows per chunk of the delta, and the size the delta may reach, in multiples of
+// IndexParams::deltaSize, before appends wait for the fold that runs.
+const size_t DELTACHUNKBYTES = (size_t)4 << 20;
+const int DELTABACKLOG = 4;
+
+// Rows appended to the delta. Rows are laid out in dimension-major blocks of LEAFBLOCK rows (value d
+// of row r at ((r / LEAFBLOCK) * dim + d) * LEAFBLOCK + r % LEAFBLOCK). Only the rows [0, count) are
+// ever read; a row is written before count is raised past it.
+struct DeltaChunk
+{
+    HugeVector<double> rows;
+    atomic<int> count;
+
+    DeltaChunk(int capacity, int dim, int pages)
+        : rows((size_t)capacity * dim, 0, HugePageAllocator<double>(pages)), count(0) {}
+};
+
+// One published version: the tree over the first base points and the chunks of the delta, holding
+// the points base, base + 1, ... in order. Every chunk but the last is full or sealed.
+template <class Engine>
+struct DeltaGeneration
+{
+    shared_ptr<Engine> tree;
+    int base;
+    int dim;
+    vector<shared_ptr<DeltaChunk>> chunks;
+
+    DeltaGeneration() : base(0), dim(0) {}
+};
+
+template <class Engine>
+class DeltaIndex : public TreeIndex
+{
+    Snapshot<DeltaGeneration<Engine>> snapshot;
+    mutable mutex writer;       // maketree, folds, setParams
+    mutable mutex appender;     // appends and the publication of generations
+    condition_variable due;     // the delta reached the next fold
+    condition_variable room;    // a fold ended
+    IndexParams params;
+    atomic<int> threads;        // IndexParams::threads, read by queries without the writer lock
+    atomic<int> pages;          // IndexParams::hugePages, read by appends
+    vector<DataVector> indexed; // points of the current tree, for the next fold
+    size_t deltaRows;           // points in the delta of the current generation
+    size_t foldAt;              // deltaRows that starts the next fold
+    size_t sealedChunks;        // chunks of the current generation a fold is taking in
+    int threshold;              // IndexParams::deltaSize
+    bool folding;
+    bool stopping;
+    thread folder;
+
+    // Rows per chunk: about DELTACHUNKBYTES of them, whole blocks.
+    static int chunkRows(int dim)
+    {
+        return max(1, (int)(DELTACHUNKBYTES / sizeof(double) / max(1, dim) / LEAFBLOCK)) * LEAFBLOCK;
+    }
+
+    // Upper bound of the memory of a build over n points of dimension dim (see
+    // TreeIndex::estimateMemory): the tree, the copies of its points kept for the next fold, and a
+    // full delta.
+    static MemoryEstimate estimate(size_t n, int dim, const IndexParams &params)
+    {
+        MemoryEstimate memory = Engine(params).estimateMemory(n, dim);
+        size_t delta = (size_t)DELTABACKLOG * max(0, params.deltaSize) + 2 * chunkRows(dim);
+        memory.dataset += n * (sizeof(DataVector) + dim * sizeof(double)) + delta * dim * sizeof(double);
+        return memory;
+    }
+
+    // The parameters of the trees: those of the index, without a memory budget of their own, as the
+    // index admits every build as a whole (see estimate).
+    IndexParams treeParams(IndexParams given) const
+    {
+        given.memoryBudget = 0;
+        return given;
+    }
+
+    // A new Engine over points, with the attributes of the index.
+    shared_ptr<Engine> build(const vector<DataVector> &points)
+    {
+        shared_ptr<Engine> tree = make_shared<Engine>(treeParams(params));
+        shared_ptr<const PointAttributes> attributes = pinAttributes();
+        if (attributes)
+        {
+            tree->setAttributes(attributes);
+        }
+        tree->maketree(points);
+        return tree;
+    }
+
+    // Copy point to the end of the delta. Called with appender locked.
+    void appendRow(const DataVector &point)
+    {
+        vector<double> v = point.getVector();
+        shared_ptr<const DeltaGeneration<Engine>> current = snapshot.pin();
+        if (!current || (current->dim == 0 && current->chunks.empty()))
+        {
+            // the first point ever, or the first after a tree over no points
+            shared_ptr<DeltaGeneration<Engine>> first = current ? make_shared<DeltaGeneration<Engine>>(*current)
+                                                                : make_shared<DeltaGeneration<Engine>>();
+            first->dim = v.size();
+            snapshot.publish(first);
+            current = first;
+        }
+        int dim = current->dim;
+        int capacity = chunkRows(dim);
+        DeltaChunk *chunk = current->chunks.empty() ? NULL : current->chunks.back().get();
+        if (chunk == NULL || chunk->count.load() == capacity || current->chunks.size() <= sealedChunks)
+        {
+            shared_ptr<DeltaGeneration<Engine>> grown = make_shared<DeltaGeneration<Engine>>(*current);
+            grown->chunks.push_back(make_shared<DeltaChunk>(capacity, dim, pages));
+            chunk = grown->chunks.back().get();
+            snapshot.publish(grown);
+        }
+        int r = chunk->count.load(memory_order_relaxed);
+        double *block = &chunk->rows[((size_t)(r / LEAFBLOCK) * dim) * LEAFBLOCK + r % LEAFBLOCK];
+        for (int d = 0; d < dim; d++)
+        {
+            block[(size_t)d * LEAFBLOCK] = v[d];
+        }
+        chunk->count.store(r + 1, memory_order_release);
+        deltaRows++;
+    }
+
+    // Row r of chunk into out.
+    static void decode(const DeltaChunk &chunk, int r, int dim, double *out)
+    {
+        const double *block = &chunk.rows[((size_t)(r / LEAFBLOCK) * dim) * LEAFBLOCK + r % LEAFBLOCK];
+        for (int d = 0; d < dim; d++)
+        {
+            out[d] = block[(size_t)d * LEAFBLOCK];
+        }
+    }
+
+    // Merge the points of the delta of gen into nearest, the k nearest (distance, id) pairs found so
+    // far sorted by distance, keeping only the points that match filter if there is one. Every
+    // full block is scored with one call of the vertical kernel; a part-written last block row by
+    // row.
+    static void scanDelta(const DeltaGeneration<Engine> &gen, const double *query, int k,
+                          vector<pair<double, int>> &nearest, const PointFilter *filter = NULL,
+                          const PointAttributes *attributes = NULL)
+    {
+        if (k <= 0 || gen.chunks.empty())
+        {
+            return;
+        }
+        TraceSpan span("delta");
+        int dim = gen.dim;
+        // max-heap of the best k so far
+        vector<pair<double, int>> best(nearest);
+        make_heap(best.begin(), best.end());
+        double dists[LEAFBLOCK];
+        int id = gen.base;
+        for (size_t c = 0; c < gen.chunks.size(); c++)
+        {
+            const DeltaChunk &chunk = *gen.chunks[c];
+            int count = chunk.count.load(memory_order_acquire);
+            for (int first = 0; first < count; first += LEAFBLOCK)
+            {
+                int lanes = min(LEAFBLOCK, count - first);
+                const double *block = &chunk.rows[(size_t)(first / LEAFBLOCK) * dim * LEAFBLOCK];
+                if (lanes == LEAFBLOCK)
+                {
+                    blockSquaredDistances(query, block, dim, dists);
+                }
+                else
+                {
+                    for (int j = 0; j < lanes; j++)
+                    {
+                        double sum = 0;
+                        for (int d = 0; d < dim; d++)
+                        {
+                            double diff = block[(size_t)d * LEAFBLOCK + j] - query[d];
+                            sum += diff * diff;
+                        }
+                        dists[j] = sum;
+                    }
+                }
+                for (int j = 0; j < lanes; j++)
+                {
+                    int row = id + first + j;
+                    bool full = (int)best.size() == k;
+                    if (full && dists[j] >= best.front().first * best.front().first)
+                        continue;
+                    if (filter != NULL && (row >= attributes->size() || !filter->matches(*attributes, row)))
+                        continue;
+                    if (full)
+                    {
+                        pop_heap(best.begin(), best.end());
+                        best.pop_back();
+                    }
+                    best.push_back(make_pair(sqrt(dists[j]), row));
+                    push_heap(best.begin(), best.end());
+                }
+            }
+            id += count;
+        }
+        sort_heap(best.begin(), best.end());
+        nearest.swap(best);
+    }
+
+    // The point of id in the delta of gen.
+    static DataVector deltaPoint(const DeltaGeneration<Engine> &gen, int id)
+    {
+        vector<double> v(gen.dim);
+        int r = id - gen.base;
+        for (size_t c = 0; c < gen.chunks.size(); c++)
+        {
+            int count = gen.chunks[c]->count.load(memory_order_acquire);
+            if (r < count)
+            {
+                decode(*gen.chunks[c], r, gen.dim, v.data());
+                break;
+            }
+            r -= count;
+        }
+        return DataVector(v);
+    }
+
+    // Build a new generation over the points of the tree and the delta as it is now, without the
+    // points equal to removed if there is one. Appends go on meanwhile, into a new chunk that the new
+    // generation keeps as its delta. false if the build does not fit in the memory budget.
+    bool fold(const DataVector *removed)
+    {
+        lock_guard<mutex> lock(writer);
+        shared_ptr<const DeltaGeneration<Engine>> current;
+        size_t sealed, rows;
+        {
+            lock_guard<mutex> sealing(appender);
+            current = snapshot.pin();
+            if (!current)
+            {
+                return true;
+            }
+            sealed = current->chunks.size();
+            rows = deltaRows;
+            if (rows == 0 && removed == NULL)
+            {
+                return true;
+            }
+            sealedChunks = sealed;
+            folding = true;
+        }
+        bool admitted = admitBuild(estimate(indexed.size() + rows, current->dim, params), params);
+        shared_ptr<Engine> tree;
+        if (admitted)
+        {
+            TraceSpan span("fold");
+            vector<double> v(current->dim);
+            for (size_t c = 0; c < sealed; c++)
+            {
+                const DeltaChunk &chunk = *current->chunks[c];
+                int count = chunk.count.load(memory_order_acquire);
+                for (int r = 0; r < count; r++)
+                {
+                    decode(chunk, r, current->dim, v.data());
+                    indexed.push_back(DataVector(v));
+                }
+            }
+            if (removed != NULL)
+            {
+                indexed.erase(remove(indexed.begin(), indexed.end(), *removed), indexed.end());
+            }
+            tree = build(indexed);
+        }
+
+        lock_guard<mutex> relock(appender);
+        if (admitted)
+        {
+            shared_ptr<const DeltaGeneration<Engine>> latest = snapshot.pin();
+            shared_ptr<DeltaGeneration<Engine>> next = make_shared<DeltaGeneration<Engine>>();
+            next->tree = tree;
+            next->base = indexed.size();
+            next->dim = latest->dim;
+            next->chunks.assign(latest->chunks.begin() + sealed, latest->chunks.end());
+            snapshot.publish(next);
+            deltaRows -= rows;
+            foldAt = threshold;
+        }
+        else
+        {
+            // try again once as many points more have come in
+            foldAt = deltaRows + threshold;
+        }
+        sealedChunks = 0;
+        folding = false;
+        room.notify_all();
+        return admitted;
+    }
+
+    // The background thread: folds the delta whenever it reaches foldAt points.
+    void foldLoop()
+    {
+        unique_lock<mutex> lock(appender);
+        while (true)
+        {
+            due.wait(lock, [this] { return stopping || (threshold > 0 && deltaRows >= foldAt); });
+            if (stopping)
+            {
+                return;
+            }
+            lock.unlock();
+            fold(NULL);
+            lock.lock();
+        }
+    }
+
+public:
+    DeltaIndex(const IndexParams &params = IndexParams())
+        : params(params), threads(params.threads), pages(params.hugePages), deltaRows(0), foldAt(max(0, params.deltaSize)), sealedChunks(0),
+          threshold(max(0, params.deltaSize)), folding(false), stopping(false)
+    {
+        folder = thread(&DeltaIndex::foldLoop, this);
+    }
+
+    ~DeltaIndex()
+    {
+        {
+            lock_guard<mutex> lock(appender);
+            stopping = true;
+        }
+        due.notify_all();
+        room.notify_all();
+        folder.join();
+    }
+
+    void append(const vector<DataVector> &points)
+    {
+        unique_lock<mutex> lock(appender);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            // past the backlog, wait for the fold that is running or due
+            room.wait(lock, [this] {
+                return threshold == 0 || deltaRows < (size_t)DELTABACKLOG * threshold ||
+                       (!folding && deltaRows < foldAt) || stopping;
+            });
+            appendRow(points[i]);
+            if (threshold > 0 && !folding && deltaRows >= foldAt)
+            {
+                due.notify_one();
+            }
+        }
+    }
+
+    void append(const DataVector &point)
+    {
+        append(vector<DataVector>(1, point));
+    }
+
+    bool flush()
+    {
+        return fold(NULL);
+    }
+
+    size_t pending() const
+    {
+        lock_guard<mutex> lock(appender);
+        return deltaRows;
+    }
+
+    vector<DataVector> query_search(const DataVector &point, int k) const
+    {
+        shared_ptr<const DeltaGeneration<Engine>> gen = snapshot.pin();
+        vector<DataVector> candidates;
+        if (!gen)
+        {
+            return candidates;
+        }
+        if (gen->tree)
+        {
+            candidates = gen->tree->query_search(point, k);
+        }
+        vector<double> query = point.getVector();
+        vector<pair<double, int>> nearest;
+        scanDelta(*gen, query.data(), k, nearest);
+        for (size_t i = 0; i < nearest.size(); i++)
+        {
+            candidates.push_back(deltaPoint(*gen, nearest[i].second));
+        }
+        return candidates;
+    }
+
+    vector<pair<double, int>> knn(const DataVector &point, int k) const
+    {
+        shared_ptr<const DeltaGeneration<Engine>> gen = snapshot.pin();
+        vector<pair<double, int>> nearest;
+        if (!gen)
+        {
+            return nearest;
+        }
+        if (gen->tree)
+        {
+            nearest = gen->tree->knn(point, k);
+        }
+        vector<double> query = point.getVector();
+        scanDelta(*gen, query.data(), k, nearest);
+        return nearest;
+    }
+
+    // One batch through the tree, then the delta scanned for every query in parallel.
+    vector<vector<pair<double, int>>> batch_knn(const vector<DataVector> &queries, int k) const
+    {
+        shared_ptr<const DeltaGeneration<Engine>> gen = snapshot.pin();
+        vector<vector<pair<double, int>>> answers(queries.size());
+        if (!gen)
+        {
+            return answers;
+        }
+        if (gen->tree)
+        {
+            answers = gen->tree->batch_knn(queries, k);
+        }
+        if (!gen->chunks.empty())
+        {
+            parallelFor(queries.size(), threads, [&](int q, int) {
+                vector<double> query = queries[q].getVector();
+                scanDelta(*gen, query.data(), k, answers[q]);
+            });
+        }
+        return answers;
+    }
+
+    vector<pair<double, int>> filtered_knn(const DataVector &point, int k, const PointFilter &filter) const
+    {
+        shared_ptr<const DeltaGeneration<Engine>> gen = snapshot.pin();
+        shared_ptr<const PointAttributes> attributes = pinAttributes();
+        vector<pair<double, int>> nearest;
+        if (!gen || !attributes)
+        {
+            return nearest;
+        }
+        if (gen->tree)
+        {
+            nearest = gen->tree->filtered_knn(point, k, filter);
+        }
+        vector<double> query = point.getVector();
+        scanDelta(*gen, query.data(), k, nearest, &filter, attributes.get());
+        return nearest;
+    }
+
+    void setAttributes(shared_ptr<const PointAttributes> attributes)
+    {
+        lock_guard<mutex> lock(writer);
+        TreeIndex::setAttributes(attributes);
+        shared_ptr<const DeltaGeneration<Engine>> gen = snapshot.pin();
+        if (gen && gen->tree)
+        {
+            gen->tree->setAttributes(attributes);
+        }
+    }
+
+    // deltaSize applies at once; the rest is passed on to the tree, and to the trees of later folds.
+    void setParams(const IndexParams &newparams)
+    {
+        lock_guard<mutex> lock(writer);
+        params = newparams;
+        threads = newparams.threads;
+        pages = newparams.hugePages;
+        shared_ptr<const DeltaGeneration<Engine>> gen = snapshot.pin();
+        if (gen && gen->tree)
+        {
+            gen->tree->setParams(treeParams(newparams));
+        }
+        lock_guard<mutex> relock(appender);
+        threshold = max(0, newparams.deltaSize);
+        foldAt = threshold;
+        due.notify_one();
+        room.notify_all();
+    }
+
+    IndexParams getParams() const
+    {
+        lock_guard<mutex> lock(writer);
+        return params;
+    }
+
+    MemoryEstimate estimateMemory(size_t points, int dim) const
+    {
+        lock_guard<mutex> lock(writer);
+        return estimate(points, dim, params);
+    }
+
+    bool maketree(const vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        int dim = points.empty() ? 0 : points[0].getDimension();
+        if (!admitBuild(estimate(points.size(), dim, params), params))
+        {
+            return false;
+        }
+        shared_ptr<DeltaGeneration<Engine>> gen = make_shared<DeltaGeneration<Engine>>();
+        gen->tree = build(points);
+        gen->base = points.size();
+        gen->dim = dim;
+        indexed = points;
+
+        lock_guard<mutex> relock(appender);
+        snapshot.publish(gen);
+        deltaRows = 0;
+        foldAt = threshold;
+        room.notify_all();
+        return true;
+    }
+
+    // An append builds nothing: the memory of a full delta is part of the estimate of the tree.
+    //AddData
+    bool AddData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        points.push_back(newpoint);
+        append(newpoint);
+        return true;
+    }
+
+    //DeleteData
+    bool DeleteData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        if (!fold(&newpoint))
+        {
+            return false;
+        }
+        points.erase(remove(points.begin(), points.end(), newpoint), points.end());
+        return true;
+    }
+};
+
+// An Engine, or a ShardedIndex of params.shards of them, behind a delta segment with
+// params.deltaSize > 0.
+template <class Engine>
+TreeIndex *makeDeltaIndex(const IndexParams &params)
+{
+    if (params.deltaSize <= 0)
+        return makeIndex<Engine>(params);
+    if (params.shards > 1)
+        return new DeltaIndex<ShardedIndex<Engine>>(params);
+    return new DeltaIndex<Engine>(params);
+}
+
+#endif
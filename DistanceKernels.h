@@ -0,0 +1,450 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ____________________________*DistanceKernels* : Flat vector kernels____________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    DistanceKernels.h contains the arithmetic the indexes run on raw, contiguous rows of doubles, so
+    hot loops do not have to go through DataVector temporaries.
+
+    - double dotProduct(const double* a, const double* b, int dim):
+        Dot product of two rows.
+
+    - double squaredDistance(const double* a, const double* b, int dim):
+        Squared Euclidean distance of two rows.
+
+    - void blockedSquaredDistances(const double* Q, const double* qnorms, int nq,
+                                   const double* X, const double* xnorms, int nx, int dim, double* out):
+        Squared distances of nq query rows to nx data rows, out[i*nx + j] = |q_i - x_j|^2.
+
+        Uses |q|^2 + |x|^2 - 2 q.x with precomputed squared norms, so the work is one matrix product
+        Q X^T. The product is computed in register tiles of 4 queries x 4 rows: every row loaded from
+        memory is used for 4 dot products, and the caller keeps X small enough (a leaf, or a chunk of a
+        subtree) to stay in cache across all queries of the block. With AVX2 a tile runs along the
+        dimensions, 4 at a time.
+
+    - void blockSquaredDistances(const double* q, const double* block, int dim, double* out):
+    - void blockSquaredDistancesF32(const float* q, const float* block, int dim, double* out):
+        Squared distances of q to the LEAFBLOCK rows of a dimension-major block (block[d * LEAFBLOCK + j]
+        is feature d of row j), out[j] = |q - x_j|^2. Every step over the features broadcasts one
+        query value and updates all LEAFBLOCK sums at once, so no horizontal reduction is needed.
+
+    Kernels for the compact formats of VectorStore, each taking a float query:
+
+    - double squaredDistanceF32(const float* q, const float* x, int dim)
+    - double squaredDistanceF16(const float* q, const uint16_t* x, int dim):   x in IEEE half precision
+    - double squaredDistanceI8(const float* a, const float* scale, const int8_t* x, int dim):
+        sum of (a[i] - scale[i] * x[i])^2, the distance to a scalar-quantized row once the query has
+        been shifted by the quantizer offset (see VectorStore::prepare).
+
+    - double squaredDistancePQ(const float* table, const uint8_t* codes, int m):
+        sum of table[s * 256 + codes[s]] over the m subspaces: the distance to a product-quantized row
+        from the lookup table of the query (see VectorStore::prepare). With AVX2 the entries of 8
+        subspaces are fetched with one gather.
+
+    - uint16_t floatToHalf(float f), float halfToFloat(uint16_t h):
+        Conversions to and from IEEE half precision (round to nearest even).
+
+    With AVX2 and FMA enabled (-mavx2 -mfma, or -march=native) dotProduct, squaredDistance, the
+    blocked product, the block kernels and the compact kernels process 4 doubles / 8 floats per instruction; F16C is used
+    for the half precision conversions. Without them the scalar loops below are used.
+*/
+
+#ifndef DISTANCEKERNELS_H
+#define DISTANCEKERNELS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#if defined(__AVX2__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Rows per block of the dimension-major layout (see VectorStore::blockRows): two vectors of 4
+// doubles, or one of 8 floats, with AVX2.
+const int LEAFBLOCK = 8;
+
+#if defined(__AVX2__) && defined(__FMA__)
+// Sum of the 4 doubles of v.
+inline double horizontalSum(__m256d v)
+{
+    __m128d low = _mm256_castpd256_pd128(v), high = _mm256_extractf128_pd(v, 1);
+    low = _mm_add_pd(low, high);
+    return _mm_cvtsd_f64(_mm_add_sd(low, _mm_unpackhi_pd(low, low)));
+}
+
+// Sum of the 8 floats of v, in double.
+inline double horizontalSum(__m256 v)
+{
+    __m256d a = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+    __m256d b = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+    return horizontalSum(_mm256_add_pd(a, b));
+}
+#endif
+
+inline float halfToFloat(uint16_t h)
+{
+#if defined(__F16C__)
+    return _cvtsh_ss(h);
+#else
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        // zero or subnormal: mantissa * 2^-24
+        float value = ldexpf((float)mantissa, -24);
+        return sign ? -value : value;
+    }
+    else if (exponent == 31)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+#endif
+}
+
+inline uint16_t floatToHalf(float f)
+{
+#if defined(__F16C__)
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint16_t sign = (x >> 16) & 0x8000;
+    if ((x & 0x7fffffff) > 0x7f800000)
+    {
+        return sign | 0x7e00; // NaN
+    }
+    int exponent = (int)((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = x & 0x7fffff;
+    if (exponent >= 31)
+    {
+        return sign | 0x7c00; // overflow to infinity
+    }
+    if (exponent <= 0)
+    {
+        // subnormal half, or zero
+        if (exponent < -10)
+        {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+        {
+            half++;
+        }
+        return sign | half;
+    }
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    {
+        half++; // may carry into the exponent, which rounds up to the next power of two or infinity
+    }
+    return sign | half;
+#endif
+}
+
+inline double dotProduct(const double *a, const double *b, int dim)
+{
+    double dot = 0;
+    int i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256d acc = _mm256_setzero_pd();
+    for (; i + 4 <= dim; i += 4)
+    {
+        acc = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), acc);
+    }
+    dot = horizontalSum(acc);
+#endif
+    for (; i < dim; i++)
+    {
+        dot += a[i] * b[i];
+    }
+    return dot;
+}
+
+inline double squaredDistance(const double *a, const double *b, int dim)
+{
+    double sum = 0;
+    int i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256d acc = _mm256_setzero_pd();
+    for (; i + 4 <= dim; i += 4)
+    {
+        __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+        acc = _mm256_fmadd_pd(diff, diff, acc);
+    }
+    sum = horizontalSum(acc);
+#endif
+    for (; i < dim; i++)
+    {
+        double diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+inline void blockSquaredDistances(const double *q, const double *block, int dim, double *out)
+{
+#if defined(__AVX2__) && defined(__FMA__)
+    // two features per step on separate sums, so consecutive FMAs do not wait on each other
+    __m256d lo0 = _mm256_setzero_pd(), hi0 = lo0, lo1 = lo0, hi1 = lo0;
+    int d = 0;
+    for (; d + 2 <= dim; d += 2, block += 2 * LEAFBLOCK)
+    {
+        __m256d a = _mm256_set1_pd(q[d]), b = _mm256_set1_pd(q[d + 1]);
+        __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(block), a);
+        lo0 = _mm256_fmadd_pd(diff, diff, lo0);
+        diff = _mm256_sub_pd(_mm256_loadu_pd(block + 4), a);
+        hi0 = _mm256_fmadd_pd(diff, diff, hi0);
+        diff = _mm256_sub_pd(_mm256_loadu_pd(block + LEAFBLOCK), b);
+        lo1 = _mm256_fmadd_pd(diff, diff, lo1);
+        diff = _mm256_sub_pd(_mm256_loadu_pd(block + LEAFBLOCK + 4), b);
+        hi1 = _mm256_fmadd_pd(diff, diff, hi1);
+    }
+    if (d < dim)
+    {
+        __m256d a = _mm256_set1_pd(q[d]);
+        __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(block), a);
+        lo0 = _mm256_fmadd_pd(diff, diff, lo0);
+        diff = _mm256_sub_pd(_mm256_loadu_pd(block + 4), a);
+        hi0 = _mm256_fmadd_pd(diff, diff, hi0);
+    }
+    _mm256_storeu_pd(out, _mm256_add_pd(lo0, lo1));
+    _mm256_storeu_pd(out + 4, _mm256_add_pd(hi0, hi1));
+#else
+    double sum[LEAFBLOCK] = {};
+    for (int d = 0; d < dim; d++, block += LEAFBLOCK)
+    {
+        double value = q[d];
+        for (int j = 0; j < LEAFBLOCK; j++)
+        {
+            double diff = block[j] - value;
+            sum[j] += diff * diff;
+        }
+    }
+    copy(sum, sum + LEAFBLOCK, out);
+#endif
+}
+
+inline void blockSquaredDistancesF32(const float *q, const float *block, int dim, double *out)
+{
+    float sum[LEAFBLOCK] = {};
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = acc0;
+    int d = 0;
+    for (; d + 2 <= dim; d += 2, block += 2 * LEAFBLOCK)
+    {
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(block), _mm256_set1_ps(q[d]));
+        acc0 = _mm256_fmadd_ps(diff, diff, acc0);
+        diff = _mm256_sub_ps(_mm256_loadu_ps(block + LEAFBLOCK), _mm256_set1_ps(q[d + 1]));
+        acc1 = _mm256_fmadd_ps(diff, diff, acc1);
+    }
+    if (d < dim)
+    {
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(block), _mm256_set1_ps(q[d]));
+        acc0 = _mm256_fmadd_ps(diff, diff, acc0);
+    }
+    _mm256_storeu_ps(sum, _mm256_add_ps(acc0, acc1));
+#else
+    for (int d = 0; d < dim; d++, block += LEAFBLOCK)
+    {
+        float value = q[d];
+        for (int j = 0; j < LEAFBLOCK; j++)
+        {
+            float diff = block[j] - value;
+            sum[j] += diff * diff;
+        }
+    }
+#endif
+    for (int j = 0; j < LEAFBLOCK; j++)
+    {
+        out[j] = sum[j];
+    }
+}
+
+inline double squaredDistanceF32(const float *q, const float *x, int dim)
+{
+    double sum = 0;
+    int i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= dim; i += 8)
+    {
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(q + i), _mm256_loadu_ps(x + i));
+        acc = _mm256_fmadd_ps(diff, diff, acc);
+    }
+    sum = horizontalSum(acc);
+#endif
+    for (; i < dim; i++)
+    {
+        double diff = q[i] - x[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+inline double squaredDistanceF16(const float *q, const uint16_t *x, int dim)
+{
+    double sum = 0;
+    int i = 0;
+#if defined(__AVX2__) && defined(__FMA__) && defined(__F16C__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= dim; i += 8)
+    {
+        __m256 values = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(x + i)));
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(q + i), values);
+        acc = _mm256_fmadd_ps(diff, diff, acc);
+    }
+    sum = horizontalSum(acc);
+#endif
+    for (; i < dim; i++)
+    {
+        double diff = q[i] - halfToFloat(x[i]);
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+inline double squaredDistanceI8(const float *a, const float *scale, const int8_t *x, int dim)
+{
+    double sum = 0;
+    int i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= dim; i += 8)
+    {
+        __m256i codes = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(x + i)));
+        __m256 diff = _mm256_fnmadd_ps(_mm256_loadu_ps(scale + i), _mm256_cvtepi32_ps(codes), _mm256_loadu_ps(a + i));
+        acc = _mm256_fmadd_ps(diff, diff, acc);
+    }
+    sum = horizontalSum(acc);
+#endif
+    for (; i < dim; i++)
+    {
+        double diff = a[i] - scale[i] * x[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+inline double squaredDistancePQ(const float *table, const uint8_t *codes, int m)
+{
+    double sum = 0;
+    int s = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc = _mm256_setzero_ps();
+    const __m256i step = _mm256_setr_epi32(0, 256, 512, 768, 1024, 1280, 1536, 1792);
+    for (; s + 8 <= m; s += 8)
+    {
+        __m256i index = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(codes + s))), step);
+        acc = _mm256_add_ps(acc, _mm256_i32gather_ps(table + (size_t)s * 256, index, 4));
+    }
+    sum = horizontalSum(acc);
+#endif
+    for (; s < m; s++)
+    {
+        sum += table[s * 256 + codes[s]];
+    }
+    return sum;
+}
+
+inline void blockedSquaredDistances(const double *Q, const double *qnorms, int nq,
+                                    const double *X, const double *xnorms, int nx, int dim, double *out)
+{
+    const int TILE = 4;
+    for (int i0 = 0; i0 < nq; i0 += TILE)
+    {
+        int ni = min(TILE, nq - i0);
+        for (int j0 = 0; j0 < nx; j0 += TILE)
+        {
+            int nj = min(TILE, nx - j0);
+            double dot[TILE][TILE] = {};
+            if (ni == TILE && nj == TILE)
+            {
+                const double *q0 = Q + (size_t)i0 * dim, *q1 = q0 + dim, *q2 = q1 + dim, *q3 = q2 + dim;
+#if defined(__AVX2__) && defined(__FMA__)
+                // two rows at a time: 8 accumulators and 6 loads fit the 16 vector registers, every
+                // query load feeds 2 FMAs and every row load 4
+                for (int h = 0; h < TILE; h += 2)
+                {
+                    const double *xa = X + (size_t)(j0 + h) * dim, *xb = xa + dim;
+                    __m256d s0a = _mm256_setzero_pd(), s0b = s0a, s1a = s0a, s1b = s0a;
+                    __m256d s2a = s0a, s2b = s0a, s3a = s0a, s3b = s0a;
+                    int d = 0;
+                    for (; d + 4 <= dim; d += 4)
+                    {
+                        __m256d ba = _mm256_loadu_pd(xa + d), bb = _mm256_loadu_pd(xb + d);
+                        __m256d a = _mm256_loadu_pd(q0 + d);
+                        s0a = _mm256_fmadd_pd(a, ba, s0a); s0b = _mm256_fmadd_pd(a, bb, s0b);
+                        a = _mm256_loadu_pd(q1 + d);
+                        s1a = _mm256_fmadd_pd(a, ba, s1a); s1b = _mm256_fmadd_pd(a, bb, s1b);
+                        a = _mm256_loadu_pd(q2 + d);
+                        s2a = _mm256_fmadd_pd(a, ba, s2a); s2b = _mm256_fmadd_pd(a, bb, s2b);
+                        a = _mm256_loadu_pd(q3 + d);
+                        s3a = _mm256_fmadd_pd(a, ba, s3a); s3b = _mm256_fmadd_pd(a, bb, s3b);
+                    }
+                    dot[0][h] = horizontalSum(s0a); dot[0][h + 1] = horizontalSum(s0b);
+                    dot[1][h] = horizontalSum(s1a); dot[1][h + 1] = horizontalSum(s1b);
+                    dot[2][h] = horizontalSum(s2a); dot[2][h + 1] = horizontalSum(s2b);
+                    dot[3][h] = horizontalSum(s3a); dot[3][h + 1] = horizontalSum(s3b);
+                    for (; d < dim; d++)
+                    {
+                        dot[0][h] += q0[d] * xa[d]; dot[0][h + 1] += q0[d] * xb[d];
+                        dot[1][h] += q1[d] * xa[d]; dot[1][h + 1] += q1[d] * xb[d];
+                        dot[2][h] += q2[d] * xa[d]; dot[2][h + 1] += q2[d] * xb[d];
+                        dot[3][h] += q3[d] * xa[d]; dot[3][h + 1] += q3[d] * xb[d];
+                    }
+                }
+#else
+                const double *x0 = X + (size_t)j0 * dim, *x1 = x0 + dim, *x2 = x1 + dim, *x3 = x2 + dim;
+                for (int d = 0; d < dim; d++)
+                {
+                    double a0 = q0[d], a1 = q1[d], a2 = q2[d], a3 = q3[d];
+                    double b0 = x0[d], b1 = x1[d], b2 = x2[d], b3 = x3[d];
+                    dot[0][0] += a0 * b0; dot[0][1] += a0 * b1; dot[0][2] += a0 * b2; dot[0][3] += a0 * b3;
+                    dot[1][0] += a1 * b0; dot[1][1] += a1 * b1; dot[1][2] += a1 * b2; dot[1][3] += a1 * b3;
+                    dot[2][0] += a2 * b0; dot[2][1] += a2 * b1; dot[2][2] += a2 * b2; dot[2][3] += a2 * b3;
+                    dot[3][0] += a3 * b0; dot[3][1] += a3 * b1; dot[3][2] += a3 * b2; dot[3][3] += a3 * b3;
+                }
+#endif
+            }
+            else
+            {
+                for (int i = 0; i < ni; i++)
+                {
+                    for (int j = 0; j < nj; j++)
+                    {
+                        dot[i][j] = dotProduct(Q + (size_t)(i0 + i) * dim, X + (size_t)(j0 + j) * dim, dim);
+                    }
+                }
+            }
+
+            for (int i = 0; i < ni; i++)
+            {
+                for (int j = 0; j < nj; j++)
+                {
+                    // rounding can take the expansion slightly below zero for (near) duplicates
+                    out[(size_t)(i0 + i) * nx + j0 + j] = max(0.0, qnorms[i0 + i] + xnorms[j0 + j] - 2 * dot[i][j]);
+                }
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,273 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    __________________________*DualTreeJoin* : All k-NN join of two point sets__________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    DualTreeJoin.h computes the exact k nearest points of every query of a query set at once, with a
+    dual-tree traversal instead of one search per query.
+
+    Both sets get a KD-tree whose nodes keep the bounding box of their points (the rows of a node are
+    contiguous, as in KDTreeIndex). The two trees are then walked together, one pair of nodes (Q, R)
+    at a time:
+        - bound(Q) is the largest k-th best distance of the queries under Q found so far;
+        - the pair is skipped when the two boxes are farther apart than bound(Q), since no point of
+          R can improve any query of Q;
+        - two leaves are compared in full with the blocked distance product (BatchQuery.h), so every
+          leaf of points is read once for a whole leaf of queries;
+        - otherwise the larger node is split and the children of R are visited nearest first, so
+          the bounds tighten early.
+    Pruning a pair discards a whole block of queries x points at once, which makes the join much
+    cheaper than independent traversals for large query sets.
+
+    The query tree is cut into independent subtrees that are joined in parallel on IndexParams
+    threads threads; each subtree owns the heaps of its queries.
+
+    - Functions:
+
+        - vector<vector<pair<double, int>>> allKnnJoin(const vector<DataVector>& queries,
+                                                       const vector<DataVector>& points, int k,
+                                                       int leafSize = 32, int threads = 0):
+            Description:
+                For every query, its k nearest points as (distance, position in points) pairs sorted
+                by distance.
+*/
+
+#ifndef DUALTREEJOIN_H
+#define DUALTREEJOIN_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "DataVector.h"
+#include "TreeIndex.h"
+#include "NodeArena.h"
+#include "DistanceKernels.h"
+#include "BatchQuery.h"
+
+using namespace std;
+
+struct JoinNode
+{
+    JoinNode* left;
+    JoinNode* right;
+    const double* low;  // bounding box of the node's points
+    const double* high;
+    int begin, end;     // rows of the tree's points under this node
+    int id;             // position of the node's bound
+};
+
+// A KD-tree with bounding boxes over one of the two sets.
+struct JoinTree
+{
+    TreePoints points;
+    NodeArena<JoinNode> nodes;
+    NodeArena<double> boxes;
+    JoinNode* root;
+    int leafSize;
+
+    JoinTree() : boxes(1 << 16), root(NULL), leafSize(32) {}
+
+    void build(const vector<DataVector> &set, int leaf)
+    {
+        leafSize = max(1, leaf);
+        points.load(set);
+        vector<int> order(set.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        vector<pair<double, int>> keys(set.size());
+        root = set.empty() ? NULL : build(order, keys, 0, order.size());
+        points.permute(order);
+    }
+
+    JoinNode *build(vector<int> &order, vector<pair<double, int>> &keys, int begin, int end)
+    {
+        int dim = points.dim;
+        JoinNode *node = nodes.allocate();
+        node->id = nodes.size() - 1;
+        node->begin = begin;
+        node->end = end;
+        node->left = NULL;
+        node->right = NULL;
+
+        double *low = boxes.allocate(dim), *high = boxes.allocate(dim);
+        copy(points.row(order[begin]), points.row(order[begin]) + dim, low);
+        copy(low, low + dim, high);
+        for (int it = begin + 1; it < end; it++)
+        {
+            const double *p = points.row(order[it]);
+            for (int d = 0; d < dim; d++)
+            {
+                low[d] = min(low[d], p[d]);
+                high[d] = max(high[d], p[d]);
+            }
+        }
+        node->low = low;
+        node->high = high;
+
+        if (end - begin <= leafSize)
+        {
+            return node;
+        }
+
+        // split the widest side of the box at the median
+        int axis = 0;
+        for (int d = 1; d < dim; d++)
+        {
+            if (high[d] - low[d] > high[axis] - low[axis])
+                axis = d;
+        }
+        for (int it = begin; it < end; it++)
+        {
+            keys[it] = make_pair(points.row(order[it])[axis], order[it]);
+        }
+        int median = begin + (end - begin) / 2;
+        nth_element(keys.begin() + begin, keys.begin() + median, keys.begin() + end);
+        for (int it = begin; it < end; it++)
+        {
+            order[it] = keys[it].second;
+        }
+
+        node->left = build(order, keys, begin, median);
+        node->right = build(order, keys, median, end);
+        return node;
+    }
+};
+
+// Squared distance between two boxes, 0 if they overlap.
+inline double boxDistance(const JoinNode *a, const JoinNode *b, int dim)
+{
+    double sum = 0;
+    for (int d = 0; d < dim; d++)
+    {
+        double gap = max(a->low[d] - b->high[d], b->low[d] - a->high[d]);
+        if (gap > 0)
+            sum += gap * gap;
+    }
+    return sum;
+}
+
+// State of the join of one query subtree: the heaps of its queries and the bounds of its nodes.
+struct JoinState
+{
+    const JoinTree &queries;
+    const JoinTree &reference;
+    const vector<double> &qnorms;
+    vector<TopK> &results;
+    vector<double> &bounds;
+    vector<double> out, scratch;
+
+    JoinState(const JoinTree &queries, const JoinTree &reference, const vector<double> &qnorms,
+              vector<TopK> &results, vector<double> &bounds)
+        : queries(queries), reference(reference), qnorms(qnorms), results(results), bounds(bounds) {}
+
+    void baseCase(const JoinNode *q, const JoinNode *r)
+    {
+        int dim = queries.points.dim;
+        int nq = q->end - q->begin, nr = r->end - r->begin;
+        const VectorStore &store = reference.points.store;
+        out.resize((size_t)nq * nr);
+        blockedSquaredDistances(queries.points.row(q->begin), &qnorms[q->begin], nq,
+                                store.rows(r->begin, nr, scratch), &store.norms[r->begin], nr, dim, out.data());
+        double bound = 0;
+        for (int i = 0; i < nq; i++)
+        {
+            TopK &result = results[q->begin + i];
+            for (int j = 0; j < nr; j++)
+            {
+                result.push(out[(size_t)i * nr + j], r->begin + j);
+            }
+            bound = max(bound, result.full() ? result.worst() : numeric_limits<double>::infinity());
+        }
+        bounds[q->id] = bound;
+    }
+
+    void join(const JoinNode *q, const JoinNode *r)
+    {
+        int dim = queries.points.dim;
+        if (boxDistance(q, r, dim) > bounds[q->id])
+        {
+            return;
+        }
+
+        bool splitQuery = q->left != NULL && (r->left == NULL || q->end - q->begin >= r->end - r->begin);
+        if (q->left == NULL && r->left == NULL)
+        {
+            baseCase(q, r);
+        }
+        else if (splitQuery)
+        {
+            join(q->left, r);
+            join(q->right, r);
+            bounds[q->id] = max(bounds[q->left->id], bounds[q->right->id]);
+        }
+        else
+        {
+            // nearer child first: its points tighten the bound the farther one is checked against
+            const JoinNode *first = r->left, *second = r->right;
+            if (boxDistance(q, second, dim) < boxDistance(q, first, dim))
+            {
+                swap(first, second);
+            }
+            join(q, first);
+            join(q, second);
+        }
+    }
+};
+
+inline vector<vector<pair<double, int>>> allKnnJoin(const vector<DataVector> &queries, const vector<DataVector> &points,
+                                                   int k, int leafSize = 32, int threads = 0)
+{
+    vector<vector<pair<double, int>>> answers(queries.size());
+    if (queries.empty() || points.empty() || k <= 0)
+    {
+        return answers;
+    }
+
+    JoinTree qtree, rtree;
+    {
+        TraceSpan span("join.build");
+        qtree.build(queries, leafSize);
+        rtree.build(points, leafSize);
+        rtree.points.finish(STORE_FLOAT64, 0);
+    }
+
+    int dim = qtree.points.dim;
+    vector<double> qnorms(queries.size());
+    for (size_t q = 0; q < queries.size(); q++)
+    {
+        qnorms[q] = dotProduct(qtree.points.row(q), qtree.points.row(q), dim);
+    }
+    vector<TopK> results(queries.size(), TopK(k));
+    vector<double> bounds(qtree.nodes.size(), numeric_limits<double>::infinity());
+
+    // independent query subtrees, a few per thread so uneven ones still balance
+    vector<const JoinNode *> tasks(1, qtree.root);
+    size_t wanted = 4 * workerCount(threads);
+    for (size_t t = 0; t < tasks.size() && tasks.size() < wanted; t++)
+    {
+        if (tasks[t]->left != NULL)
+        {
+            tasks.push_back(tasks[t]->left);
+            tasks.push_back(tasks[t]->right);
+            tasks[t] = NULL;
+        }
+    }
+    tasks.erase(remove(tasks.begin(), tasks.end(), (const JoinNode *)NULL), tasks.end());
+
+    parallelFor(tasks.size(), threads, [&](int t, int) {
+        TraceSpan span("join.traverse");
+        JoinState state(qtree, rtree, qnorms, results, bounds);
+        state.join(tasks[t], rtree.root);
+    });
+
+    for (size_t q = 0; q < queries.size(); q++)
+    {
+        answers[qtree.points.ids[q]] = rtree.points.answer(qtree.points.row(q), results[q].items(), k);
+    }
+    return answers;
+}
+
+#endif
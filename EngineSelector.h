@@ -0,0 +1,198 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    _________________________*EngineSelector* : Choosing the index for a dataset_________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    EngineSelector.h picks the index expected to answer fastest for a dataset, from two estimates
+    measured on a sample of its points:
+
+        - intrinsic dimension: the number of dimensions the points actually vary in, by the maximum
+          likelihood estimator of Levina and Bickel on the SELECTNEIGHBOURS nearest neighbours of
+          every sampled point (averaged as MacKay and Ghahramani suggest). Tree pruning degrades with
+          the intrinsic dimension, not with the number of features.
+        - relative contrast: mean distance between two points over mean distance to the nearest
+          point. Near 1 every point is about as far as any other and no index can rule much out;
+          clustered data has a high contrast.
+
+    Rules, in order (chooseEngine):
+        - fewer than BRUTEFORCEPOINTS points: brute force, a tree does not pay for its traversal;
+        - intrinsic dimension above TREEMAXINTRINSIC, or contrast below MINCONTRAST: brute force,
+          the trees would visit most leaves anyway;
+        - at most KDMAXDIM features: KD-tree, whose axis-aligned splits are cheapest to test;
+        - otherwise: RP-tree, whose random projections adapt to a low intrinsic dimension hidden in
+          many features.
+
+    - Functions:
+
+        - DatasetProfile profileDataset(const vector<DataVector>& points):
+            Description:
+                The estimates for points, from at most SELECTSAMPLE of them spread evenly.
+
+        - int chooseEngine(const DatasetProfile& profile, int requested, ostream& log):
+            Description:
+                The Engine to build: requested unless it is ENGINE_AUTO, else the one the rules pick.
+                Writes the estimates and the decision, with its reason, to log.
+
+        - TreeIndex* makeEngine(int engine, const IndexParams& params):
+            Description:
+                A new index of the given Engine (sharded with params.shards > 1, see makeIndex,
+                behind a delta segment with params.deltaSize > 0, see DeltaIndex.h), NULL for
+                ENGINE_AUTO. The caller owns it.
+*/
+
+#ifndef ENGINESELECTOR_H
+#define ENGINESELECTOR_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include "DataVector.h"
+#include "TreeIndex.h"
+#include "DistanceKernels.h"
+#include "KDTreeIndex.h"
+#include "RPTreeIndex.h"
+#include "BallTreeIndex.h"
+#include "HNSWIndex.h"
+#include "BruteForceIndex.h"
+#include "ShardedIndex.h"
+#include "DeltaIndex.h"
+
+using namespace std;
+
+const int SELECTSAMPLE = 1000;
+const int SELECTNEIGHBOURS = 10;
+const int BRUTEFORCEPOINTS = 5000;
+const double TREEMAXINTRINSIC = 12;
+const double MINCONTRAST = 1.5;
+const int KDMAXDIM = 16;
+
+struct DatasetProfile
+{
+    int points;
+    int dim;
+    int sampled;
+    double intrinsicDim; // 0 when it could not be estimated
+    double contrast;     // 0 when it could not be estimated
+
+    DatasetProfile() : points(0), dim(0), sampled(0), intrinsicDim(0), contrast(0) {}
+};
+
+inline DatasetProfile profileDataset(const vector<DataVector> &points)
+{
+    DatasetProfile profile;
+    profile.points = points.size();
+    profile.dim = points.empty() ? 0 : points[0].getDimension();
+    int n = min((int)points.size(), SELECTSAMPLE);
+    int k = SELECTNEIGHBOURS;
+    profile.sampled = n;
+    if (n <= k)
+    {
+        return profile;
+    }
+
+    int dim = profile.dim;
+    vector<double> sample((size_t)n * dim);
+    for (int s = 0; s < n; s++)
+    {
+        vector<double> v = points[(size_t)s * points.size() / n].getVector();
+        copy(v.begin(), v.end(), sample.begin() + (size_t)s * dim);
+    }
+
+    double inverseSum = 0, meanSum = 0, nearestSum = 0;
+    int estimated = 0;
+    vector<double> dists;
+    for (int i = 0; i < n; i++)
+    {
+        dists.clear();
+        double total = 0;
+        for (int j = 0; j < n; j++)
+        {
+            if (j == i)
+                continue;
+            double d = sqrt(squaredDistance(&sample[(size_t)i * dim], &sample[(size_t)j * dim], dim));
+            total += d;
+            // duplicates would put log(0) in the estimate
+            if (d > 0)
+                dists.push_back(d);
+        }
+        if ((int)dists.size() < k)
+        {
+            continue;
+        }
+        partial_sort(dists.begin(), dists.begin() + k, dists.end());
+        // Levina-Bickel: 1 / m(x) = mean over j < k of log(T_k / T_j)
+        double inverse = 0;
+        for (int j = 0; j < k - 1; j++)
+        {
+            inverse += log(dists[k - 1] / dists[j]);
+        }
+        inverseSum += inverse / (k - 1);
+        meanSum += total / (n - 1);
+        nearestSum += dists[0];
+        estimated++;
+    }
+    if (estimated > 0 && inverseSum > 0)
+    {
+        profile.intrinsicDim = estimated / inverseSum;
+        profile.contrast = meanSum / nearestSum;
+    }
+    return profile;
+}
+
+inline int chooseEngine(const DatasetProfile &profile, int requested, ostream &log)
+{
+    log << "Dataset: " << profile.points << " points of dimension " << profile.dim << "; from " << profile.sampled
+        << " sampled: intrinsic dimension " << profile.intrinsicDim << ", relative contrast " << profile.contrast << "\n";
+
+    int engine;
+    const char *reason;
+    if (requested != ENGINE_AUTO)
+    {
+        engine = requested;
+        reason = "requested";
+    }
+    else if (profile.points < BRUTEFORCEPOINTS)
+    {
+        engine = ENGINE_BRUTEFORCE;
+        reason = "too few points for a tree to pay off";
+    }
+    else if (profile.intrinsicDim == 0 || profile.intrinsicDim > TREEMAXINTRINSIC || profile.contrast < MINCONTRAST)
+    {
+        engine = ENGINE_BRUTEFORCE;
+        reason = "intrinsic dimension too high or contrast too low for a tree to prune";
+    }
+    else if (profile.dim <= KDMAXDIM)
+    {
+        engine = ENGINE_KD;
+        reason = "few features and a low intrinsic dimension";
+    }
+    else
+    {
+        engine = ENGINE_RP;
+        reason = "a low intrinsic dimension among many features";
+    }
+    log << "Engine: " << engineName(engine) << " (" << reason << ")" << endl;
+    return engine;
+}
+
+inline TreeIndex *makeEngine(int engine, const IndexParams &params)
+{
+    switch (engine)
+    {
+    case ENGINE_KD:
+        return makeDeltaIndex<KDTreeIndex>(params);
+    case ENGINE_RP:
+        return makeDeltaIndex<RPTreeIndex>(params);
+    case ENGINE_BALL:
+        return makeDeltaIndex<BallTreeIndex>(params);
+    case ENGINE_HNSW:
+        return makeDeltaIndex<HNSWIndex>(params);
+    case ENGINE_BRUTEFORCE:
+        return makeDeltaIndex<BruteForceIndex>(params);
+    default:
+        return NULL;
+    }
+}
+
+#endif
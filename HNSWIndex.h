@@ -0,0 +1,803 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    __________________________*HNSWIndex* : The HNSWIndex class__________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    HNSWIndex.h contains a hierarchical navigable small world graph index. Instead of cutting space
+    into cells, every point is linked to near points on a stack of layers: every point is on layer 0,
+    and each layer above holds a random 1/M of the layer below it. A query walks greedily down from
+    the single entry point on the top layer and then runs a best-first search of width efSearch on
+    layer 0. Unlike the trees it does not degrade to a scan of most of the data in high dimensions.
+
+    Parameters (IndexParams):
+        - M:              links per point on the upper layers; 2 * M on layer 0.
+        - efConstruction: candidates kept while looking for the links of a new point.
+        - efSearch:       candidates kept by a query (raised to the number a query has to keep).
+        - threads:        points are inserted by this many threads, each locking only the link lists
+                          it changes.
+        - storage/rerank: as for the trees. The graph is built on the exact rows, queries scan the
+                          stored ones.
+
+    The links are kept flat: layer 0 is one array with a fixed slot of 1 + 2M ints per point (the
+    count, then the neighbours), the upper layers one array with 1 + M ints per point and layer.
+
+    filtered_knn runs the same search of width efSearch, but only keeps the points that match the
+    filter; the ones that do not are still walked through, as they link the ones that do.
+
+    The built graph (HNSWGraph) is immutable and published through a Snapshot, so queries run
+    concurrently with AddData / DeleteData, which rebuild it, and never wait for a build (see the
+    concurrency model in TreeIndex.h). A query also takes the lock of the pool of visited lists
+    twice, for as long as it takes to pop or push one list.
+
+    - Member Functions (besides the TreeIndex ones):
+
+        - bool save(const string& filename) const:
+            Description:
+                Write the published graph, its rows and its ids to a binary file.
+
+        - bool load(const string& filename):
+            Description:
+                Read a graph written by save() and publish it. The storage mode and rerank of the
+                current parameters apply to the loaded rows. A file whose header, layout or links do
+                not describe a graph build() could have made is refused and nothing is published.
+*/
+
+#ifndef HNSWINDEX_H
+#define HNSWINDEX_H
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <queue>
+#include <cstring>
+#include "DataVector.h"
+#include "TreeIndex.h"
+#include "DistanceKernels.h"
+
+using namespace std;
+
+// Most links a loaded graph may keep per node and level.
+const int HNSWMAXLINKS = 1 << 16;
+
+// A fully built HNSW graph. Never modified once published.
+struct HNSWGraph
+{
+    TreePoints points;  // rows in the order of the points given to maketree
+    int M;              // largest number of links on the upper layers
+    int M0;             // largest number of links on layer 0
+    int entry;          // entry point on the top layer, -1 while empty
+    int maxLevel;       // top layer
+    vector<int> levels; // top layer of every point
+    HugeVector<int> base;  // layer 0: (1 + M0) ints per point
+    HugeVector<int> upper; // layers 1..levels[i] of point i: (1 + M) ints per layer, from upperAt[i]
+    vector<size_t> upperAt;
+
+    HNSWGraph() : M(16), M0(32), entry(-1), maxLevel(-1) {}
+
+    // Link list of point i on level: the number of links, then the links.
+    int *links(int i, int level)
+    {
+        return level == 0 ? &base[(size_t)i * (M0 + 1)] : &upper[upperAt[i] + (size_t)(level - 1) * (M + 1)];
+    }
+
+    const int *links(int i, int level) const
+    {
+        return level == 0 ? &base[(size_t)i * (M0 + 1)] : &upper[upperAt[i] + (size_t)(level - 1) * (M + 1)];
+    }
+
+    // Lay out empty link lists for points whose levels are known, in the huge page mode of the points.
+    void allocate(int m)
+    {
+        M = max(2, m);
+        M0 = 2 * M;
+        int n = levels.size();
+        base = HugeVector<int>((size_t)n * (M0 + 1), 0, points.ids.get_allocator());
+        upperAt.resize(n);
+        size_t at = 0;
+        for (int i = 0; i < n; i++)
+        {
+            upperAt[i] = at;
+            at += (size_t)levels[i] * (M + 1);
+        }
+        upper = HugeVector<int>(at, 0, points.ids.get_allocator());
+    }
+};
+
+class HNSWIndex : public TreeIndex
+{
+    Snapshot<HNSWGraph> snapshot;
+    mutable mutex writer;
+    shared_ptr<HNSWGraph> published, retired;
+    IndexParams params;
+    atomic<int> efSearch;
+    atomic<int> threads;
+
+    // Marks the points a search has reached. Clearing is O(1): a new search takes a new tag.
+    struct Visited
+    {
+        vector<unsigned> marks;
+        unsigned tag;
+
+        Visited() : tag(0) {}
+
+        void start(int n)
+        {
+            if ((int)marks.size() != n || ++tag == 0)
+            {
+                marks.assign(n, 0);
+                tag = 1;
+            }
+        }
+
+        // true the first time i is seen in this search
+        bool visit(int i)
+        {
+            if (marks[i] == tag)
+                return false;
+            marks[i] = tag;
+            return true;
+        }
+    };
+
+    // Visited lists of finished searches, reused by the next ones.
+    mutable mutex poolLock;
+    mutable vector<unique_ptr<Visited>> pool;
+
+    unique_ptr<Visited> takeVisited() const
+    {
+        lock_guard<mutex> lock(poolLock);
+        if (pool.empty())
+        {
+            return unique_ptr<Visited>(new Visited());
+        }
+        unique_ptr<Visited> visited = move(pool.back());
+        pool.pop_back();
+        return visited;
+    }
+
+    void giveVisited(unique_ptr<Visited> visited) const
+    {
+        lock_guard<mutex> lock(poolLock);
+        pool.push_back(move(visited));
+    }
+
+    // Copy the links of i on level, under the lock of i while the graph is being built (locks is
+    // NULL once it is published).
+    static void readLinks(const HNSWGraph &graph, int i, int level, vector<mutex> *locks, vector<int> &out)
+    {
+        unique_lock<mutex> lock;
+        if (locks != NULL)
+        {
+            lock = unique_lock<mutex>((*locks)[i]);
+        }
+        const int *list = graph.links(i, level);
+        out.assign(list + 1, list + 1 + list[0]);
+    }
+
+    // Greedy walk on level from start: moves to the nearest neighbour as long as it is closer.
+    template <class Distance>
+    static int greedy(const HNSWGraph &graph, Distance distance, int start, double &startDist, int level, vector<mutex> *locks)
+    {
+        int current = start;
+        vector<int> neighbours;
+        bool moved = true;
+        while (moved)
+        {
+            moved = false;
+            readLinks(graph, current, level, locks, neighbours);
+            for (size_t j = 0; j < neighbours.size(); j++)
+            {
+                double d = distance(neighbours[j]);
+                if (d < startDist)
+                {
+                    startDist = d;
+                    current = neighbours[j];
+                    moved = true;
+                }
+            }
+        }
+        return current;
+    }
+
+    // Every row is a candidate answer of an unfiltered search.
+    struct KeepAll
+    {
+        bool operator()(int) const
+        {
+            return true;
+        }
+    };
+
+    // Best-first search of width ef on level from start. Returns the ef nearest points found as
+    // (squared distance, row) pairs, in no particular order. Only the rows keep accepts are returned;
+    // the others are still walked through, so a filter does not cut the graph into pieces.
+    template <class Distance, class Keep = KeepAll>
+    static vector<pair<double, int>> searchLayer(const HNSWGraph &graph, Distance distance, int start, double startDist,
+                                                 int ef, int level, Visited &visited, vector<mutex> *locks,
+                                                 Keep keep = Keep())
+    {
+        typedef pair<double, int> Item;
+        priority_queue<Item, vector<Item>, greater<Item>> candidates; // nearest first
+        priority_queue<Item> found;                                   // farthest first
+
+        visited.start(graph.levels.size());
+        visited.visit(start);
+        candidates.push(Item(startDist, start));
+        if (keep(start))
+        {
+            found.push(Item(startDist, start));
+        }
+
+        vector<int> neighbours;
+        while (!candidates.empty())
+        {
+            Item current = candidates.top();
+            if ((int)found.size() >= ef && current.first > found.top().first)
+            {
+                break;
+            }
+            candidates.pop();
+
+            readLinks(graph, current.second, level, locks, neighbours);
+            for (size_t j = 0; j < neighbours.size(); j++)
+            {
+                int next = neighbours[j];
+                if (!visited.visit(next))
+                {
+                    continue;
+                }
+                double d = distance(next);
+                if ((int)found.size() < ef || d < found.top().first)
+                {
+                    candidates.push(Item(d, next));
+                    if (keep(next))
+                    {
+                        found.push(Item(d, next));
+                        if ((int)found.size() > ef)
+                        {
+                            found.pop();
+                        }
+                    }
+                }
+            }
+        }
+
+        vector<Item> result;
+        result.reserve(found.size());
+        while (!found.empty())
+        {
+            result.push_back(found.top());
+            found.pop();
+        }
+        return result;
+    }
+
+    // Neighbour selection heuristic: walking the candidates from the nearest, keep a candidate only
+    // if it is closer to the new point than to every candidate kept so far, which spreads the links
+    // in different directions instead of into one dense cluster.
+    static vector<int> selectNeighbours(const TreePoints &points, vector<pair<double, int>> candidates, int m)
+    {
+        sort(candidates.begin(), candidates.end());
+        vector<int> selected;
+        for (size_t c = 0; c < candidates.size() && (int)selected.size() < m; c++)
+        {
+            const double *p = points.row(candidates[c].second);
+            bool keep = true;
+            for (size_t s = 0; s < selected.size() && keep; s++)
+            {
+                keep = squaredDistance(p, points.row(selected[s]), points.dim) >= candidates[c].first;
+            }
+            if (keep)
+            {
+                selected.push_back(candidates[c].second);
+            }
+        }
+        return selected;
+    }
+
+    // Shared state of the threads inserting into one graph.
+    struct HNSWBuild
+    {
+        HNSWGraph &graph;
+        int efConstruction;
+        vector<mutex> locks; // one per point, guards its link lists
+        mutex top;           // guards graph.entry and graph.maxLevel
+
+        HNSWBuild(HNSWGraph &graph, int efConstruction)
+            : graph(graph), efConstruction(efConstruction), locks(graph.levels.size()) {}
+    };
+
+    // Link point i into the graph.
+    static void insert(HNSWBuild &build, int i, Visited &visited)
+    {
+        HNSWGraph &graph = build.graph;
+        const TreePoints &points = graph.points;
+        int dim = points.dim;
+        const double *point = points.row(i);
+        int level = graph.levels[i];
+        auto distance = [&](int row) { return squaredDistance(point, points.row(row), dim); };
+
+        // a point that becomes the new top keeps the entry locked until it is linked
+        unique_lock<mutex> top(build.top);
+        int entry = graph.entry;
+        int maxLevel = graph.maxLevel;
+        if (entry < 0)
+        {
+            graph.entry = i;
+            graph.maxLevel = level;
+            return;
+        }
+        if (level <= maxLevel)
+        {
+            top.unlock();
+        }
+
+        double entryDist = distance(entry);
+        for (int l = maxLevel; l > level; l--)
+        {
+            entry = greedy(graph, distance, entry, entryDist, l, &build.locks);
+        }
+
+        for (int l = min(level, maxLevel); l >= 0; l--)
+        {
+            vector<pair<double, int>> found =
+                searchLayer(graph, distance, entry, entryDist, build.efConstruction, l, visited, &build.locks);
+            vector<int> selected = selectNeighbours(points, found, graph.M);
+            int limit = l == 0 ? graph.M0 : graph.M;
+
+            {
+                lock_guard<mutex> lock(build.locks[i]);
+                int *list = graph.links(i, l);
+                list[0] = selected.size();
+                copy(selected.begin(), selected.end(), list + 1);
+            }
+
+            // link back, pruning the neighbour's list with the same heuristic when it is full
+            for (size_t s = 0; s < selected.size(); s++)
+            {
+                int other = selected[s];
+                lock_guard<mutex> lock(build.locks[other]);
+                int *list = graph.links(other, l);
+                if (list[0] < limit)
+                {
+                    list[1 + list[0]] = i;
+                    list[0]++;
+                    continue;
+                }
+                const double *p = points.row(other);
+                vector<pair<double, int>> candidates;
+                candidates.push_back(make_pair(squaredDistance(p, point, dim), i));
+                for (int j = 1; j <= list[0]; j++)
+                {
+                    candidates.push_back(make_pair(squaredDistance(p, points.row(list[j]), dim), list[j]));
+                }
+                vector<int> kept = selectNeighbours(points, candidates, limit);
+                list[0] = kept.size();
+                copy(kept.begin(), kept.end(), list + 1);
+            }
+
+            // the nearest point found is the entry of the next level down
+            for (size_t f = 0; f < found.size(); f++)
+            {
+                if (found[f].first < entryDist)
+                {
+                    entryDist = found[f].first;
+                    entry = found[f].second;
+                }
+            }
+        }
+
+        if (level > maxLevel)
+        {
+            graph.entry = i;
+            graph.maxLevel = level;
+        }
+    }
+
+    // initial call to build the graph
+    static void buildGraph(HNSWGraph &graph, const vector<DataVector> &points, const IndexParams &params)
+    {
+        TraceSpan span("hnsw.build");
+        graph.points.setHugePages(params.hugePages);
+        graph.points.load(points);
+        graph.entry = -1;
+        graph.maxLevel = -1;
+
+        // levels are drawn up front (geometric with ratio 1/M), so the flat link arrays can be laid
+        // out before any thread starts inserting
+        mt19937 gen(5489u);
+        uniform_real_distribution<double> unit(0.0, 1.0);
+        double scale = 1 / log(max(2, params.M));
+        graph.levels.resize(points.size());
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            graph.levels[i] = (int)(-log(1 - unit(gen)) * scale);
+        }
+        graph.allocate(params.M);
+        link(graph, params);
+        TraceSpan finish("hnsw.finish");
+        graph.points.finish(params.storage, params.rerank, params.pqSubspaces);
+    }
+
+    // Insert every point of graph, in parallel.
+    static void link(HNSWGraph &graph, const IndexParams &params)
+    {
+        int n = graph.levels.size();
+        if (n == 0)
+        {
+            return;
+        }
+        TraceSpan span("hnsw.link");
+        HNSWBuild build(graph, max(params.efConstruction, params.M));
+        Visited first;
+        insert(build, 0, first);
+
+        // each worker thread keeps one visited list for all its points
+        vector<Visited> visited(workerCount(params.threads));
+        parallelFor(n - 1, params.threads, [&](int i, int worker) { insert(build, i + 1, visited[worker]); });
+    }
+
+    // The (squared distance, row) pairs of the ef nearest rows found for query, among the rows keep
+    // accepts.
+    template <class Keep = KeepAll>
+    vector<pair<double, int>> search(const HNSWGraph &graph, const double *point, int ef, Keep keep = Keep()) const
+    {
+        const TreePoints &points = graph.points;
+        if (graph.entry < 0)
+        {
+            return vector<pair<double, int>>();
+        }
+        TraceSpan span("hnsw.search");
+        StoreQuery query = points.store.prepare(point);
+        auto distance = [&](int row) { return points.store.squaredDistance(query, row); };
+
+        int entry = graph.entry;
+        double entryDist = distance(entry);
+        for (int l = graph.maxLevel; l > 0; l--)
+        {
+            entry = greedy(graph, distance, entry, entryDist, l, NULL);
+        }
+        unique_ptr<Visited> visited = takeVisited();
+        vector<pair<double, int>> found = searchLayer(graph, distance, entry, entryDist, ef, 0, *visited, NULL, keep);
+        giveVisited(move(visited));
+        return found;
+    }
+
+    // Upper bound of the memory of a build over n points of dimension dim (see TreeIndex::estimateMemory).
+    static MemoryEstimate estimate(size_t n, int dim, const IndexParams &params)
+    {
+        MemoryEstimate memory = TreePoints::estimate(n, dim, params);
+        size_t M = max(2, params.M);
+        // layer 0, and the upper layers: 1 / (M - 1) of them per point on average (levels are
+        // geometric with ratio 1 / M), plus the levels, the offsets and the locks of the build
+        memory.nodes = n * ((2 * M + 1) * sizeof(int) + ((M + 1) * sizeof(int) + M - 2) / (M - 1) + sizeof(int) +
+                            sizeof(size_t) + sizeof(mutex)) + hugePageSlack(params, 2);
+        // one visited list per worker
+        memory.caches = workerCount(params.threads) * n * sizeof(unsigned);
+        return memory;
+    }
+
+    // Build a graph over points off to the side and make it the current version, unless it does not
+    // fit in the memory budget, in which case it returns false.
+    bool rebuild(const vector<DataVector> &points)
+    {
+        if (!admitBuild(estimate(points.size(), points.empty() ? 0 : points[0].getDimension(), params), params))
+        {
+            return false;
+        }
+        // Recycle the graph retired by the previous update if no reader holds it any more (see
+        // KDTreeIndex::rebuild); its arrays keep their capacity.
+        shared_ptr<HNSWGraph> graph;
+        if (retired && retired.use_count() == 1)
+        {
+            atomic_thread_fence(memory_order_acquire);
+            graph.swap(retired);
+        }
+        else
+        {
+            graph = make_shared<HNSWGraph>();
+        }
+        retired.reset();
+
+        buildGraph(*graph, points, params);
+        publish(graph);
+        return true;
+    }
+
+    void publish(shared_ptr<HNSWGraph> graph)
+    {
+        snapshot.publish(graph);
+        retired = published;
+        published = graph;
+    }
+
+    // Whether a graph read from a file is one build() could have made: the layout of the link lists
+    // matches the levels, and every id and link names a point, on a level it reaches.
+    static bool valid(const HNSWGraph &graph)
+    {
+        const TreePoints &points = graph.points;
+        size_t n = points.ids.size();
+        if (points.dim <= 0 || points.data.size() / points.dim != n || points.data.size() % points.dim != 0 ||
+            graph.levels.size() != n || graph.upperAt.size() != n)
+        {
+            return false;
+        }
+        if (graph.M < 2 || graph.M0 < 2 || graph.M > HNSWMAXLINKS || graph.M0 > HNSWMAXLINKS ||
+            graph.base.size() / (graph.M0 + 1) != n || graph.base.size() % (graph.M0 + 1) != 0)
+        {
+            return false;
+        }
+        if (n == 0 ? graph.entry != -1 || graph.maxLevel != -1
+                   : graph.entry < 0 || (size_t)graph.entry >= n || graph.levels[graph.entry] != graph.maxLevel)
+        {
+            return false;
+        }
+        vector<bool> seen(n, false);
+        size_t at = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            int id = points.ids[i];
+            if (id < 0 || (size_t)id >= n || seen[id] || graph.levels[i] < 0 || graph.levels[i] > graph.maxLevel ||
+                graph.upperAt[i] != at)
+            {
+                return false;
+            }
+            seen[id] = true;
+            at += (size_t)graph.levels[i] * (graph.M + 1);
+            if (at > graph.upper.size())
+            {
+                return false;
+            }
+        }
+        if (at != graph.upper.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            for (int level = 0; level <= graph.levels[i]; level++)
+            {
+                const int *links = graph.links(i, level);
+                int count = links[0];
+                if (count < 0 || count > (level == 0 ? graph.M0 : graph.M))
+                {
+                    return false;
+                }
+                for (int j = 1; j <= count; j++)
+                {
+                    if (links[j] < 0 || (size_t)links[j] >= n || graph.levels[links[j]] < level)
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    template <class T, class A>
+    static void writeArray(ofstream &file, const vector<T, A> &values)
+    {
+        size_t n = values.size();
+        file.write((const char *)&n, sizeof(n));
+        file.write((const char *)values.data(), n * sizeof(T));
+    }
+
+    // Reads an array written by writeArray; false, without allocating, if its length does not fit in
+    // the rest of the file.
+    template <class T, class A>
+    static bool readArray(ifstream &file, vector<T, A> &values)
+    {
+        size_t n = 0;
+        if (!file.read((char *)&n, sizeof(n)))
+        {
+            return false;
+        }
+        streampos here = file.tellg();
+        file.seekg(0, ios::end);
+        size_t remaining = file.tellg() - here;
+        file.seekg(here);
+        if (n > remaining / sizeof(T))
+        {
+            return false;
+        }
+        values.resize(n);
+        return (bool)file.read((char *)values.data(), n * sizeof(T));
+    }
+
+public:
+    HNSWIndex(const IndexParams &params = IndexParams())
+        : params(params), efSearch(params.efSearch), threads(params.threads) {}
+
+    vector<DataVector> query_search(const DataVector &point, int k) const
+    {
+        shared_ptr<const HNSWGraph> graph = snapshot.pin();
+        if (!graph)
+        {
+            return vector<DataVector>();
+        }
+        vector<double> query = point.getVector();
+        vector<pair<double, int>> found = search(*graph, query.data(), max(efSearch.load(), k));
+
+        vector<DataVector> candidates;
+        candidates.reserve(found.size());
+        for (size_t i = 0; i < found.size(); i++)
+        {
+            candidates.push_back(graph->points.get(found[i].second));
+        }
+        return candidates;
+    }
+
+    vector<pair<double, int>> knn(const DataVector &point, int k) const
+    {
+        shared_ptr<const HNSWGraph> graph = snapshot.pin();
+        if (!graph)
+        {
+            return vector<pair<double, int>>();
+        }
+        vector<double> query = point.getVector();
+        const TreePoints &points = graph->points;
+        vector<pair<double, int>> found = search(*graph, query.data(), max(efSearch.load(), points.keep(k)));
+        return points.answer(query.data(), found, k);
+    }
+
+    // The graph has no nodes to summarize: the search walks it as knn does, with the same width, but
+    // only keeps the points that match filter.
+    vector<pair<double, int>> filtered_knn(const DataVector &point, int k, const PointFilter &filter) const
+    {
+        shared_ptr<const HNSWGraph> graph = snapshot.pin();
+        shared_ptr<const PointAttributes> attributes = pinAttributes();
+        if (!graph || !attributes)
+        {
+            return vector<pair<double, int>>();
+        }
+        vector<double> query = point.getVector();
+        const TreePoints &points = graph->points;
+        auto keep = [&](int row) { return filter.matches(*attributes, points.ids[row]); };
+        vector<pair<double, int>> found = search(*graph, query.data(), max(efSearch.load(), points.keep(k)), keep);
+        return points.answer(query.data(), found, k);
+    }
+
+    // A graph search reads scattered rows, so there are no shared leaves to scan together: the
+    // queries of a batch are spread over the worker threads instead.
+    vector<vector<pair<double, int>>> batch_knn(const vector<DataVector> &queries, int k) const
+    {
+        vector<vector<pair<double, int>>> answers(queries.size());
+        parallelFor(queries.size(), threads, [&](int q, int) { answers[q] = knn(queries[q], k); });
+        return answers;
+    }
+
+    void setParams(const IndexParams &newparams)
+    {
+        lock_guard<mutex> lock(writer);
+        params = newparams;
+        efSearch = newparams.efSearch;
+        threads = newparams.threads;
+    }
+
+    IndexParams getParams() const
+    {
+        lock_guard<mutex> lock(writer);
+        return params;
+    }
+
+    MemoryEstimate estimateMemory(size_t points, int dim) const
+    {
+        lock_guard<mutex> lock(writer);
+        return estimate(points, dim, params);
+    }
+
+    bool maketree(const vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        return rebuild(points);
+    }
+
+    //AddData
+    bool AddData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size() + 1, newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        points.push_back(newpoint);
+        return rebuild(points);
+    }
+
+    //DeleteData
+    bool DeleteData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size(), newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        points.erase(remove(points.begin(), points.end(), newpoint), points.end());
+        return rebuild(points);
+    }
+
+    bool save(const string &filename) const
+    {
+        shared_ptr<const HNSWGraph> graph = snapshot.pin();
+        if (!graph)
+        {
+            cerr << "Nothing to save: no graph has been built" << endl;
+            return false;
+        }
+        TraceSpan span("save.binary");
+        ofstream file(filename, ios::binary);
+        if (!file.is_open())
+        {
+            cerr << "Error opening file: " << filename << endl;
+            return false;
+        }
+
+        const TreePoints &points = graph->points;
+        int header[6] = {0x57534e48, points.dim, graph->M, graph->M0, graph->entry, graph->maxLevel};
+        file.write((const char *)header, sizeof(header));
+
+        // the rows are written as doubles: exact for float64, the exact copy if there is one, the
+        // decoded codes otherwise
+        vector<double> rows((size_t)points.size() * points.dim);
+        for (int i = 0; i < points.size(); i++)
+        {
+            (points.exact.size() > 0 ? points.exact : points.store).decode(i, &rows[(size_t)i * points.dim]);
+        }
+        writeArray(file, rows);
+        writeArray(file, points.ids);
+        writeArray(file, graph->levels);
+        writeArray(file, graph->base);
+        writeArray(file, graph->upper);
+        writeArray(file, graph->upperAt);
+        return (bool)file;
+    }
+
+    bool load(const string &filename)
+    {
+        TraceSpan span("load.binary");
+        ifstream file(filename, ios::binary);
+        if (!file.is_open())
+        {
+            cerr << "Error opening file: " << filename << endl;
+            return false;
+        }
+
+        shared_ptr<HNSWGraph> graph = make_shared<HNSWGraph>();
+        TreePoints &points = graph->points;
+        int pages = getParams().hugePages;
+        points.setHugePages(pages);
+        graph->base = HugeVector<int>(HugePageAllocator<int>(pages));
+        graph->upper = HugeVector<int>(HugePageAllocator<int>(pages));
+        int header[6];
+        bool ok = file.read((char *)header, sizeof(header)) && header[0] == 0x57534e48;
+        if (ok)
+        {
+            points.dim = header[1];
+            graph->M = header[2];
+            graph->M0 = header[3];
+            graph->entry = header[4];
+            graph->maxLevel = header[5];
+            ok = readArray(file, points.data) && readArray(file, points.ids) && readArray(file, graph->levels) &&
+                 readArray(file, graph->base) && readArray(file, graph->upper) && readArray(file, graph->upperAt);
+        }
+        if (!ok || !valid(*graph))
+        {
+            cerr << "Not an HNSW graph file: " << filename << endl;
+            return false;
+        }
+
+        lock_guard<mutex> lock(writer);
+        points.finish(params.storage, params.rerank, params.pqSubspaces);
+        publish(graph);
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,181 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ______________________________*HugePages* : Huge-page-backed memory______________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    HugePages.h contains the allocator of the large flat arrays of an index: the rows and ids of
+    TreePoints (VectorStore), the chunks of the NodeArenas and the link lists of HNSWIndex. A tree
+    walk or a leaf scan over gigabytes of 4K pages misses the TLB at almost every node; on 2MB pages
+    one TLB entry covers 512 times more memory.
+
+    Every block of at least HUGEPAGEMIN bytes is mapped on its own, rounded up to and aligned on
+    HUGEPAGESIZE (2MB), in the mode of IndexParams::hugePages of the index it belongs to. The mode
+    travels with every container (the HugePageAllocator of a HugeVector, a NodeArena), so indexes
+    built with different modes at the same time do not affect each other:
+
+        - HUGEPAGES_NONE:        plain anonymous memory; the kernel's default policy applies.
+        - HUGEPAGES_TRANSPARENT: the mapping is advised MADV_HUGEPAGE, so transparent huge pages
+                                 back it whenever the kernel has them (THP "madvise" or "always").
+        - HUGEPAGES_EXPLICIT:    the mapping comes from the reserved huge page pool (MAP_HUGETLB,
+                                 see /proc/sys/vm/nr_hugepages). When the pool is empty or too small
+                                 the block falls back to transparent huge pages, with one note on
+                                 cerr.
+
+    Smaller blocks, and every block on systems without mmap, come from operator new. The mode only
+    changes how new blocks are mapped; blocks are released the same way whatever the mode was when
+    they were mapped, so any allocator can release the blocks of any other.
+
+    - Functions:
+
+        - void* hugeAllocate(size_t bytes, int mode), void hugeRelease(void* p, size_t bytes):
+            Description:
+                A block of bytes as described above, and its release (with the same bytes).
+
+    - HugePageAllocator<T>, HugeVector<T>:
+        The standard allocator interface over hugeAllocate, carrying its HugePageMode (HUGEPAGES_NONE
+        by default), and a vector using it. The allocator moves and swaps along with the contents,
+        so a HugeVector keeps the mode it was made with: HugeVector<T>(HugePageAllocator<T>(mode)).
+*/
+
+#ifndef HUGEPAGES_H
+#define HUGEPAGES_H
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+enum HugePageMode
+{
+    HUGEPAGES_NONE,
+    HUGEPAGES_TRANSPARENT,
+    HUGEPAGES_EXPLICIT
+};
+
+inline const char *hugePageName(int mode)
+{
+    return mode == HUGEPAGES_TRANSPARENT ? "transparent" : mode == HUGEPAGES_EXPLICIT ? "explicit" : "none";
+}
+
+inline int hugePageMode(const string &name)
+{
+    if (name == "transparent")
+        return HUGEPAGES_TRANSPARENT;
+    if (name == "explicit")
+        return HUGEPAGES_EXPLICIT;
+    return HUGEPAGES_NONE;
+}
+
+const size_t HUGEPAGESIZE = (size_t)2 << 20;
+// Smallest block mapped on its own: half of the huge page it takes is wasted at worst.
+const size_t HUGEPAGEMIN = HUGEPAGESIZE / 2;
+
+inline void *hugeAllocate(size_t bytes, int mode)
+{
+#if defined(__linux__)
+    if (bytes >= HUGEPAGEMIN)
+    {
+        size_t length = (bytes + HUGEPAGESIZE - 1) / HUGEPAGESIZE * HUGEPAGESIZE;
+#if defined(MAP_HUGETLB)
+        if (mode == HUGEPAGES_EXPLICIT)
+        {
+            void *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED)
+            {
+                return p;
+            }
+            static atomic<bool> noted(false);
+            if (!noted.exchange(true))
+            {
+                cerr << "Not enough explicit huge pages reserved, using transparent huge pages" << endl;
+            }
+        }
+#endif
+        // map one huge page more than needed and trim it, so the block starts on a huge page boundary
+        char *p = (char *)mmap(NULL, length + HUGEPAGESIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            throw bad_alloc();
+        }
+        size_t head = (HUGEPAGESIZE - (uintptr_t)p % HUGEPAGESIZE) % HUGEPAGESIZE;
+        if (head > 0)
+        {
+            munmap(p, head);
+        }
+        munmap(p + head + length, HUGEPAGESIZE - head);
+        p += head;
+#if defined(MADV_HUGEPAGE)
+        if (mode != HUGEPAGES_NONE)
+        {
+            madvise(p, length, MADV_HUGEPAGE);
+        }
+#endif
+        return p;
+    }
+#endif
+    return ::operator new(bytes);
+}
+
+inline void hugeRelease(void *p, size_t bytes)
+{
+#if defined(__linux__)
+    if (bytes >= HUGEPAGEMIN)
+    {
+        munmap(p, (bytes + HUGEPAGESIZE - 1) / HUGEPAGESIZE * HUGEPAGESIZE);
+        return;
+    }
+#endif
+    ::operator delete(p);
+}
+
+template <class T>
+struct HugePageAllocator
+{
+    typedef T value_type;
+    typedef true_type propagate_on_container_copy_assignment;
+    typedef true_type propagate_on_container_move_assignment;
+    typedef true_type propagate_on_container_swap;
+
+    int mode;
+
+    HugePageAllocator(int mode = HUGEPAGES_NONE) : mode(mode) {}
+    template <class U>
+    HugePageAllocator(const HugePageAllocator<U> &other) : mode(other.mode) {}
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(hugeAllocate(n * sizeof(T), mode));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        hugeRelease(p, n * sizeof(T));
+    }
+};
+
+// Any allocator releases the blocks of any other (see above).
+template <class T, class U>
+bool operator==(const HugePageAllocator<T> &, const HugePageAllocator<U> &)
+{
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const HugePageAllocator<T> &, const HugePageAllocator<U> &)
+{
+    return false;
+}
+
+template <class T>
+using HugeVector = vector<T, HugePageAllocator<T>>;
+
+#endif
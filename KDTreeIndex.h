@@ -0,0 +1,674 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ___________________________*KDTreeIndex* : The KDTreeIndex class___________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    KDTreeIndex.h contains the KD-tree index. Every internal node splits its points on one feature,
+    chosen by IndexParams::splitRule (by default the median of the feature with the largest
+    variance); leaves hold at most IndexParams::leafSize points.
+
+    The tree keeps its points in one flat buffer (TreePoints) laid out in tree order, so a node only
+    stores the row range of its points. Nodes come from the tree's NodeArena.
+
+    With point attributes attached (setAttributes), every node keeps the AttributeSummary of its
+    points, and filtered_knn walks the tree nearest child first, skipping the subtrees whose summary
+    rules the filter out and testing the filter on every point of a leaf before scoring it.
+
+    With IndexParams::rotation set, the nodes split on rotated coordinates instead of the original
+    features (see Rotation.h): a PCA or a random Hadamard rotation of the points, learned at build
+    time and applied to every query before it walks the tree, optionally truncated to the first
+    IndexParams::rotationDims coordinates. The leaves still hold the original vectors, so every
+    distance, and the rerank of lossy storage, is computed in full.
+
+    With IndexParams::leafBlocks, median splits fall on multiples of LEAFBLOCK rows and the leaf size
+    is rounded up to one, so every leaf is a run of whole dimension-major blocks of the store (see
+    VectorStore::blockRows) and its scan computes LEAFBLOCK distances per pass over the features.
+    The sliding midpoint rule splits where the data says, so its leaves are not aligned, but still
+    scanned a block at a time.
+
+    The built tree (KDTree) is immutable and published through a Snapshot, so queries run
+    concurrently with AddData / DeleteData and never wait for a build (see the concurrency model in
+    TreeIndex.h).
+*/
+
+#ifndef KDTREEINDEX_H
+#define KDTREEINDEX_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <limits>
+#include "DataVector.h"
+#include "TreeIndex.h"
+#include "NodeArena.h"
+#include "DistanceKernels.h"
+#include "BatchQuery.h"
+
+using namespace std;
+
+struct KDNode
+{
+    KDNode* left;
+    KDNode* right;
+    double medianval;
+    int axis;
+    int begin, end; // rows of the tree's points under this node
+    AttributeSummary summary; // of the points under this node, with attributes
+};
+
+// A fully built KD-tree. Never modified once published.
+struct KDTree
+{
+    TreePoints points;
+    NodeArena<KDNode> nodes;
+    KDNode* root;
+    int leafSize;
+    int leafAlign; // every leaf starts on a multiple of this row (see leafAlignment)
+    shared_ptr<const PointAttributes> attributes; // those the node summaries were built from
+    Rotation rotation; // of the coordinates the nodes split on, inactive for the original features
+
+    KDTree() : root(NULL), leafSize(MINSIZE), leafAlign(1) {}
+
+    // The coordinates of point the nodes split on: point itself, or its rotation written to scratch.
+    const double *splitCoordinates(const double *point, vector<double> &scratch) const
+    {
+        if (!rotation.active())
+        {
+            return point;
+        }
+        scratch.resize(rotation.size());
+        rotation.apply(point, scratch.data());
+        return scratch.data();
+    }
+};
+
+class KDTreeIndex : public TreeIndex
+{
+    Snapshot<KDTree> snapshot;
+    mutable mutex writer;
+    shared_ptr<KDTree> published, retired;
+    IndexParams params;
+    atomic<int> searchBudget;
+
+    // State of one build: the split rule and scratch space shared by every node.
+    struct KDBuild
+    {
+        KDTree &tree;
+        int rule;
+        int sampleSize;
+        mt19937 gen;
+        vector<int> order;
+        vector<pair<double, int>> keys;
+        vector<double> sum, sumsq, low, high;
+
+        KDBuild(KDTree &tree, const IndexParams &params)
+            : tree(tree), rule(params.splitRule), sampleSize(params.splitSample), gen(5489u) {}
+    };
+
+    // Choose Rule
+    // Returns the feature to split the points [begin, end) of order on. The statistics of all features
+    // come from one pass over the rows (over a random sample of sampleSize rows in larger nodes);
+    // low and high receive the range of the chosen feature.
+    static int chooseRule(KDBuild &build, int begin, int end, double &low, double &high)
+    {
+        const TreePoints &points = build.tree.points;
+        int dim = points.dim;
+        int n = end - begin;
+        bool sampled = build.sampleSize > 0 && n > build.sampleSize;
+        int count = sampled ? build.sampleSize : n;
+
+        // features are accumulated relative to the first point, which keeps the sum of squares from
+        // cancelling for data far from the origin
+        const double *shift = points.row(build.order[begin]);
+        build.sum.assign(dim, 0);
+        build.sumsq.assign(dim, 0);
+        build.low.assign(dim, numeric_limits<double>::infinity());
+        build.high.assign(dim, -numeric_limits<double>::infinity());
+        double *sum = build.sum.data(), *sumsq = build.sumsq.data();
+        double *lo = build.low.data(), *hi = build.high.data();
+
+        uniform_int_distribution<int> pick(begin, end - 1);
+        for (int s = 0; s < count; s++)
+        {
+            const double *p = points.row(build.order[sampled ? pick(build.gen) : begin + s]);
+            for (int i = 0; i < dim; i++)
+            {
+                double v = p[i] - shift[i];
+                sum[i] += v;
+                sumsq[i] += v * v;
+                lo[i] = min(lo[i], v);
+                hi[i] = max(hi[i], v);
+            }
+        }
+
+        // calculate variance (or spread) of each feature and return the feature with the maximum
+        int axis = 0;
+        double best = -1;
+        for (int i = 0; i < dim; i++)
+        {
+            double score = build.rule == SPLIT_VARIANCE ? sumsq[i] - sum[i] * sum[i] / count : hi[i] - lo[i];
+            if (score > best)
+            {
+                best = score;
+                axis = i;
+            }
+        }
+        low = lo[axis] + shift[axis];
+        high = hi[axis] + shift[axis];
+        return axis;
+    }
+
+    // Sliding midpoint: partitions keys [begin, end) into keys <= value and keys > value. If one side
+    // would be empty (low and high may come from a sample), value slides to the nearest key so that
+    // side gets at least one point. Returns the first position of the right side, -1 if all keys are
+    // equal; value receives the split value used.
+    static int slidingSplit(vector<pair<double, int>> &keys, int begin, int end, double &value)
+    {
+        auto first = keys.begin() + begin, last = keys.begin() + end;
+        double split = value;
+        auto atOrBelow = [&split](const pair<double, int> &key) { return key.first <= split; };
+
+        auto mid = partition(first, last, atOrBelow);
+        if (mid == first)
+        {
+            // nothing at or below value: slide down to the smallest key
+            split = min_element(first, last)->first;
+            mid = partition(first, last, atOrBelow);
+        }
+        else if (mid == last)
+        {
+            // nothing above value: slide up to the largest key below the maximum
+            double top = max_element(first, last)->first;
+            double below = -numeric_limits<double>::infinity();
+            for (auto it = first; it != last; it++)
+            {
+                if (it->first < top)
+                    below = max(below, it->first);
+            }
+            split = below;
+            mid = partition(first, last, atOrBelow);
+        }
+
+        if (mid == first || mid == last)
+        {
+            return -1;
+        }
+        value = split;
+        return mid - keys.begin();
+    }
+
+    // initial call to build tree
+    static void buildTree(KDTree &tree, const vector<DataVector>& points, const IndexParams &params)
+    {
+        TraceSpan span("kd.build");
+        tree.nodes.reset();
+        tree.nodes.setHugePages(params.hugePages);
+        tree.points.setHugePages(params.hugePages);
+        tree.leafSize = leafCapacity(params);
+        tree.leafAlign = leafAlignment(params);
+        tree.root = NULL;
+        tree.rotation.learn(points, params.rotation, params.rotationDims);
+        if (tree.rotation.active())
+        {
+            TraceSpan rotate("kd.rotate");
+            tree.points.load(points, tree.rotation);
+        }
+        else
+        {
+            tree.points.load(points);
+        }
+        if (points.empty())
+        {
+            return;
+        }
+
+        KDBuild build(tree, params);
+        build.order.resize(points.size());
+        build.keys.resize(points.size());
+        for (size_t i = 0; i < build.order.size(); i++)
+        {
+            build.order[i] = i;
+        }
+        tree.root = buildTree(build, 0, build.order.size());
+        if (tree.rotation.active())
+        {
+            // the nodes split on rotated coordinates, the leaves are scanned on the original ones
+            tree.points.load(points);
+        }
+        // lay the rows out in tree order, so every node's points are contiguous
+        tree.points.permute(build.order);
+        if (tree.attributes)
+        {
+            summarize(tree, tree.root);
+        }
+        TraceSpan finish("kd.finish");
+        tree.points.finish(params.storage, params.rerank, params.pqSubspaces, params.varianceOrder, params.leafBlocks);
+    }
+
+    // Fill in the attribute summaries of node and its subtree.
+    static const AttributeSummary &summarize(KDTree &tree, KDNode *node)
+    {
+        node->summary = AttributeSummary();
+        if (node->left == NULL)
+        {
+            for (int i = node->begin; i < node->end; i++)
+            {
+                node->summary.add(tree.attributes->summary(tree.points.ids[i]));
+            }
+        }
+        else
+        {
+            node->summary.add(summarize(tree, node->left));
+            node->summary.add(summarize(tree, node->right));
+        }
+        return node->summary;
+    }
+
+    // Overloaded buildTree function for a range of order (actual implementation)
+    static KDNode *buildTree(KDBuild &build, int begin, int end)
+    {
+        KDTree &tree = build.tree;
+        const TreePoints &points = tree.points;
+        vector<int> &order = build.order;
+        vector<pair<double, int>> &keys = build.keys;
+
+        KDNode *newnode = tree.nodes.allocate();
+        newnode->axis = 0;
+        newnode->begin = begin;
+        newnode->end = end;
+        newnode->left = NULL;
+        newnode->right = NULL;
+        newnode->medianval = -1;
+
+        if (end - begin <= tree.leafSize)
+        {
+            return newnode;
+        }
+
+        // only large nodes get spans: there are too many small ones
+        bool traced = end - begin >= TRACE_MINNODE;
+        double low, high;
+        int axis;
+        {
+            TraceSpan span(traced ? "kd.chooseRule" : NULL);
+            axis = chooseRule(build, begin, end, low, high);
+        }
+        newnode->axis = axis;
+
+        int split;
+        {
+            TraceSpan span(traced ? "kd.partition" : NULL);
+            for (int it = begin; it != end; it++)
+            {
+                keys[it] = make_pair(points.row(order[it])[axis], order[it]);
+            }
+
+            if (build.rule == SPLIT_MIDPOINT)
+            {
+                double value = (low + high) / 2;
+                split = slidingSplit(keys, begin, end, value);
+                if (split < 0)
+                {
+                    // every point has the same value on the widest feature: they are all equal
+                    return newnode;
+                }
+                newnode->medianval = value;
+            }
+            else
+            {
+                // split at the median; neither half has to be sorted
+                split = medianSplit(begin, end, tree.leafAlign);
+                nth_element(keys.begin() + begin, keys.begin() + split - 1, keys.begin() + end);
+                newnode->medianval = keys[split - 1].first;
+            }
+            for (int it = begin; it != end; it++)
+            {
+                order[it] = keys[it].second;
+            }
+        }
+
+        newnode->left = buildTree(build, begin, split);
+        newnode->right = buildTree(build, split, end);
+
+        return newnode;
+    }
+    // Returns the rows of the candidate neighbours of the query, whose coordinates in the space the
+    // nodes split on are point. A sibling subtree is only added while the candidates stay within
+    // budget (0 for no limit), unless there are fewer than k of them.
+    static vector<int> search(const TreePoints &points, const StoreQuery &query, const double *point, const KDNode* node, int k=1, int budget=0)
+    {
+        vector<int> nneighbours;
+        if (node == NULL)
+        {
+            return nneighbours;
+        }
+        if (node->left == NULL)
+        {
+            for (int i = node->begin; i < node->end; i++)
+            {
+                nneighbours.push_back(i);
+            }
+            return nneighbours;
+        }
+
+        double compareval = point[node->axis];
+        const KDNode *sibling;
+        if (compareval <= node->medianval)
+        {
+            nneighbours = search(points, query, point, node->left,k,budget);
+            sibling = node->right;
+        }
+        else
+        {
+            nneighbours = search(points, query, point, node->right,k,budget);
+            sibling = node->left;
+        }
+
+        //if the distance of the given point from the farthest point in the current subtree is less than the perpendicular distance of the given point from the median, then return the left subtree else return the current node
+        double maxdist = points.farthest(query, nneighbours);
+        double mediandist = abs(node->medianval - point[node->axis]);
+
+        bool affordable = budget <= 0 || (int)nneighbours.size() + sibling->end - sibling->begin <= budget;
+
+        if ((maxdist > mediandist * mediandist && affordable) || (int)nneighbours.size() < k) {
+            for (int i = sibling->begin; i < sibling->end; i++)
+            {
+                nneighbours.push_back(i);
+            }
+        }
+        return nneighbours;
+
+    }
+
+    // Adds the rows under node that match filter to result, nearer child first (point: the query in
+    // the space the nodes split on). A subtree is skipped
+    // when its summary rules the filter out, or when it is farther than the k-th best so far; once
+    // result is full, no more than budget rows (0 for no limit) are scanned.
+    static void filteredSearch(const KDTree &tree, const StoreQuery &query, const double *point, const KDNode *node,
+                               const PointFilter &filter, TopK &result, int &scanned, int budget)
+    {
+        if (!filter.mayMatch(node->summary))
+        {
+            return;
+        }
+        const TreePoints &points = tree.points;
+        if (node->left == NULL)
+        {
+            for (int i = node->begin; i < node->end; i++)
+            {
+                if (!filter.matches(*tree.attributes, points.ids[i]))
+                    continue;
+                double bound = result.full() ? result.worst() : numeric_limits<double>::infinity();
+                result.push(points.store.squaredDistance(query, i, bound), i);
+                scanned++;
+            }
+            return;
+        }
+
+        bool left = point[node->axis] <= node->medianval;
+        filteredSearch(tree, query, point, left ? node->left : node->right, filter, result, scanned, budget);
+        double mediandist = abs(node->medianval - point[node->axis]);
+        bool affordable = budget <= 0 || scanned < budget;
+        if (!result.full() || (mediandist * mediandist < result.worst() && affordable))
+        {
+            filteredSearch(tree, query, point, left ? node->right : node->left, filter, result, scanned, budget);
+        }
+    }
+
+    // Upper bound of the memory of a build over n points of dimension dim (see TreeIndex::estimateMemory).
+    static MemoryEstimate estimate(size_t n, int dim, const IndexParams &params)
+    {
+        MemoryEstimate memory = TreePoints::estimate(n, dim, params, params.leafBlocks);
+        if (params.rotation != ROTATE_NONE)
+        {
+            // the rotated coordinates the tree is built on, at most 2 dim of them (Hadamard padding)
+            memory.dataset += n * 2 * dim * sizeof(double);
+        }
+        memory.nodes = treeNodes(n, leafCapacity(params)) * sizeof(KDNode) + hugePageSlack(params, 1);
+        // the order and sort keys of the build
+        memory.ids += n * (sizeof(int) + sizeof(pair<double, int>));
+        return memory;
+    }
+
+    // Build a tree over points off to the side and make it the current version, unless it does not
+    // fit in the memory budget, in which case it returns false.
+    bool rebuild(const vector<DataVector> &points)
+    {
+        if (!admitBuild(estimate(points.size(), points.empty() ? 0 : points[0].getDimension(), params), params))
+        {
+            return false;
+        }
+        // Recycle the tree retired by the previous update if no reader holds it any more: it is no
+        // longer published, so nobody can pin it again, and resetting its arena frees every node at once.
+        shared_ptr<KDTree> tree;
+        if (retired && retired.use_count() == 1)
+        {
+            atomic_thread_fence(memory_order_acquire);
+            tree.swap(retired);
+        }
+        else
+        {
+            tree = make_shared<KDTree>();
+        }
+        retired.reset();
+
+        tree->attributes = pinAttributes();
+        buildTree(*tree, points, params);
+        snapshot.publish(tree);
+
+        retired = published;
+        published = tree;
+        return true;
+    }
+
+public:
+    KDTreeIndex(const IndexParams &params = IndexParams()) : params(params), searchBudget(params.searchBudget) {}
+
+    vector<DataVector> query_search(const DataVector &point, int k) const
+    {
+        shared_ptr<const KDTree> tree = snapshot.pin();
+        if (!tree)
+        {
+            return vector<DataVector>();
+        }
+        vector<double> query = point.getVector();
+        vector<double> scratch;
+        vector<int> rows;
+        {
+            TraceSpan span("kd.search");
+            rows = search(tree->points, tree->points.store.prepare(query.data()), tree->splitCoordinates(query.data(), scratch),
+                          tree->root, k, searchBudget);
+        }
+
+        vector<DataVector> candidates;
+        candidates.reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            candidates.push_back(tree->points.get(rows[i]));
+        }
+        return candidates;
+    }
+
+    vector<pair<double, int>> knn(const DataVector &point, int k) const
+    {
+        shared_ptr<const KDTree> tree = snapshot.pin();
+        if (!tree)
+        {
+            return vector<pair<double, int>>();
+        }
+        vector<double> query = point.getVector();
+        vector<double> scratch;
+        vector<int> rows;
+        {
+            TraceSpan span("kd.search");
+            rows = search(tree->points, tree->points.store.prepare(query.data()), tree->splitCoordinates(query.data(), scratch),
+                          tree->root, k, searchBudget);
+        }
+        return tree->points.nearest(query.data(), rows, k);
+    }
+
+    // Falls back to the over-fetching TreeIndex::filtered_knn when the tree was built without the
+    // attributes attached now.
+    vector<pair<double, int>> filtered_knn(const DataVector &point, int k, const PointFilter &filter) const
+    {
+        shared_ptr<const KDTree> tree = snapshot.pin();
+        if (!tree || tree->root == NULL)
+        {
+            return vector<pair<double, int>>();
+        }
+        if (!tree->attributes || tree->attributes != pinAttributes())
+        {
+            return TreeIndex::filtered_knn(point, k, filter);
+        }
+        vector<double> query = point.getVector();
+        vector<double> scratch;
+        TopK result(tree->points.keep(k));
+        int scanned = 0;
+        filteredSearch(*tree, tree->points.store.prepare(query.data()), tree->splitCoordinates(query.data(), scratch), tree->root,
+                       filter, result, scanned, searchBudget);
+        return tree->points.answer(query.data(), result.items(), k);
+    }
+
+    vector<vector<pair<double, int>>> batch_knn(const vector<DataVector> &queries, int k) const
+    {
+        vector<vector<pair<double, int>>> answers(queries.size());
+        shared_ptr<const KDTree> tree = snapshot.pin();
+        if (!tree || tree->root == NULL)
+        {
+            return answers;
+        }
+        const TreePoints &points = tree->points;
+        int budget = searchBudget;
+
+        TreePoints flat;
+        flat.load(queries);
+        vector<TopK> results(queries.size(), TopK(points.keep(k)));
+        vector<ScanJob> jobs;
+        // the queries in the space the nodes split on
+        TreePoints turned;
+        if (tree->rotation.active())
+        {
+            turned.load(queries, tree->rotation);
+        }
+        const TreePoints &split = tree->rotation.active() ? turned : flat;
+
+        // first round: every query scans its own leaf
+        {
+            TraceSpan span("batch.route");
+            for (size_t q = 0; q < queries.size(); q++)
+            {
+                const double *point = split.row(q);
+                const KDNode *node = tree->root;
+                while (node->left != NULL)
+                {
+                    node = point[node->axis] <= node->medianval ? node->left : node->right;
+                }
+                ScanJob job = {NULL, node->begin, node->end, (int)q};
+                jobs.push_back(job);
+            }
+        }
+        runScanJobs(points, flat, jobs, results);
+
+        // second round: going back up from the leaf, scan the sibling subtrees that can still hold a
+        // point closer than the current k-th best (the same rule as search(), with budget)
+        jobs.clear();
+        {
+            TraceSpan span("batch.route");
+            vector<const KDNode *> path;
+            for (size_t q = 0; q < queries.size(); q++)
+            {
+                const double *point = split.row(q);
+                path.clear();
+                const KDNode *node = tree->root;
+                while (node->left != NULL)
+                {
+                    path.push_back(node);
+                    node = point[node->axis] <= node->medianval ? node->left : node->right;
+                }
+
+                double bound = results[q].worst();
+                int collected = node->end - node->begin;
+                for (int i = (int)path.size() - 1; i >= 0; i--)
+                {
+                    const KDNode *parent = path[i];
+                    const KDNode *sibling = point[parent->axis] <= parent->medianval ? parent->right : parent->left;
+                    double mediandist = abs(parent->medianval - point[parent->axis]);
+                    int size = sibling->end - sibling->begin;
+                    bool affordable = budget <= 0 || collected + size <= budget;
+                    if ((bound > mediandist * mediandist && affordable) || collected < k)
+                    {
+                        ScanJob job = {NULL, sibling->begin, sibling->end, (int)q};
+                        jobs.push_back(job);
+                        collected += size;
+                    }
+                }
+            }
+        }
+        runScanJobs(points, flat, jobs, results);
+
+        {
+            TraceSpan span("batch.answer");
+            for (size_t q = 0; q < queries.size(); q++)
+            {
+                answers[q] = points.answer(flat.row(q), results[q].items(), k);
+            }
+        }
+        return answers;
+    }
+
+    void setParams(const IndexParams &newparams)
+    {
+        lock_guard<mutex> lock(writer);
+        params = newparams;
+        searchBudget = newparams.searchBudget;
+    }
+
+    IndexParams getParams() const
+    {
+        lock_guard<mutex> lock(writer);
+        return params;
+    }
+
+    MemoryEstimate estimateMemory(size_t points, int dim) const
+    {
+        lock_guard<mutex> lock(writer);
+        return estimate(points, dim, params);
+    }
+
+    bool maketree(const vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        return rebuild(points);
+    }
+
+    //AddData
+    bool AddData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size() + 1, newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        points.push_back(newpoint);
+        return rebuild(points);
+    }
+
+    //DeleteData
+    bool DeleteData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size(), newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        points.erase(remove(points.begin(), points.end(), newpoint), points.end());
+        return rebuild(points);
+    }
+};
+
+#endif
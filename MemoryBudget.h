@@ -0,0 +1,77 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ___________________________*MemoryBudget* : Memory estimates of a build___________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    MemoryBudget.h contains the estimate of the memory an index needs to build over a given number of
+    points (TreeIndex::estimateMemory), broken down by component:
+
+        - dataset: the rows of the index (TreePoints: the build buffer, its copy in tree order, the
+                   encoded store, the exact copy of lossy storage, the norms), and the copies of the
+                   points an index keeps as DataVectors (ShardedIndex, DeltaIndex) and a full delta
+                   segment (DeltaIndex);
+        - nodes:   tree nodes, split directions, ball centres, HNSW link lists;
+        - ids:     the ids of the rows and the orders and sort keys of the build;
+        - caches:  memory held for queries: cached answers (CachedIndex), per-thread visited marks
+                   (HNSWIndex).
+
+    The estimate is an upper bound of the peak of one build, computed from the parameters alone
+    before anything is allocated, so a build that can not fit in IndexParams::memoryBudget is
+    refused up front (see admitBuild in TreeIndex.h) instead of running out of memory halfway. The
+    points given to maketree belong to the caller and are not counted. With IndexParams::hugePages
+    every large array is rounded up to a whole huge page, which each component allows for
+    (hugePageSlack in TreeIndex.h).
+*/
+
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <iostream>
+#include <cstddef>
+
+using namespace std;
+
+struct MemoryEstimate
+{
+    size_t dataset;
+    size_t nodes;
+    size_t ids;
+    size_t caches;
+
+    MemoryEstimate() : dataset(0), nodes(0), ids(0), caches(0) {}
+
+    size_t total() const
+    {
+        return dataset + nodes + ids + caches;
+    }
+
+    void add(const MemoryEstimate &other)
+    {
+        dataset += other.dataset;
+        nodes += other.nodes;
+        ids += other.ids;
+        caches += other.caches;
+    }
+
+    // The same estimate count times over.
+    MemoryEstimate times(size_t count) const
+    {
+        MemoryEstimate scaled;
+        scaled.dataset = dataset * count;
+        scaled.nodes = nodes * count;
+        scaled.ids = ids * count;
+        scaled.caches = caches * count;
+        return scaled;
+    }
+
+    // "dataset 1200 MB, nodes 30 MB, ids 8 MB, caches 0 MB, total 1238 MB"
+    void describe(ostream &out) const
+    {
+        const size_t MB = 1 << 20;
+        out << "dataset " << (dataset + MB - 1) / MB << " MB, nodes " << (nodes + MB - 1) / MB << " MB, ids "
+            << (ids + MB - 1) / MB << " MB, caches " << (caches + MB - 1) / MB << " MB, total "
+            << (total() + MB - 1) / MB << " MB";
+    }
+};
+
+#endif
@@ -0,0 +1,132 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    _____________________________*NodeArena* : The NodeArena class_____________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    NodeArena.h contains a bump allocator for tree nodes (and other per-node arrays such as the
+    split directions of RPTreeIndex).
+
+    Memory is taken from a list of large chunks. allocate() only moves a cursor forward, so building a
+    tree no longer goes through the global allocator once per node, and every tree owns its own
+    arena, so parallel builds do not contend on a shared heap.
+
+    Chunks come from hugeAllocate (see HugePages.h), in the arena's own HugePageMode. While huge pages
+    are on, a chunk fills a whole huge page at least, so the nodes of a tree share few TLB entries.
+
+    Nothing is ever freed one object at a time: reset() rewinds the cursor and keeps the chunks for the
+    next build (O(1)), the destructor releases the chunks. T therefore has to be trivially
+    destructible.
+
+    - Member Functions:
+
+        - T* allocate(size_t count = 1):
+            Description:
+                Return room for count contiguous, value-initialized objects.
+
+        - void reset():
+            Description:
+                Forget every object handed out so far. The chunks are kept for reuse.
+
+        - void setHugePages(int mode):
+            Description:
+                The HugePageMode of the chunks mapped from now on (HUGEPAGES_NONE at first).
+
+        - size_t size() const:
+            Description:
+                Number of objects handed out since the last reset().
+*/
+
+#ifndef NODEARENA_H
+#define NODEARENA_H
+
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <cstddef>
+#include <type_traits>
+#include "HugePages.h"
+
+using namespace std;
+
+template <class T>
+class NodeArena
+{
+    static_assert(is_trivially_destructible<T>::value, "NodeArena never runs destructors");
+
+    struct Chunk
+    {
+        T *memory;
+        size_t capacity;
+    };
+
+    vector<Chunk> chunks;
+    size_t chunkSize;
+    size_t current; // chunk the cursor is in
+    size_t used;    // objects used in chunks[current]
+    size_t count;
+    int pages;      // HugePageMode of new chunks
+
+    NodeArena(const NodeArena &);
+    NodeArena &operator=(const NodeArena &);
+
+public:
+    explicit NodeArena(size_t chunkSize = 4096) : chunkSize(chunkSize), current(0), used(0), count(0), pages(HUGEPAGES_NONE) {}
+
+    ~NodeArena()
+    {
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            hugeRelease(chunks[i].memory, chunks[i].capacity * sizeof(T));
+        }
+    }
+
+    T *allocate(size_t n = 1)
+    {
+        // move on to the first chunk (kept from before a reset, or new) that has room for n objects
+        while (current < chunks.size() && used + n > chunks[current].capacity)
+        {
+            current++;
+            used = 0;
+        }
+        if (current == chunks.size())
+        {
+            Chunk c;
+            c.capacity = max(chunkSize, n);
+            if (pages != HUGEPAGES_NONE)
+            {
+                c.capacity = max(c.capacity, HUGEPAGESIZE / sizeof(T));
+            }
+            c.memory = static_cast<T *>(hugeAllocate(c.capacity * sizeof(T), pages));
+            chunks.push_back(c);
+            used = 0;
+        }
+
+        T *p = chunks[current].memory + used;
+        for (size_t i = 0; i < n; i++)
+        {
+            new (p + i) T();
+        }
+        used += n;
+        count += n;
+        return p;
+    }
+
+    void reset()
+    {
+        current = 0;
+        used = 0;
+        count = 0;
+    }
+
+    void setHugePages(int mode)
+    {
+        pages = mode;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+};
+
+#endif
@@ -0,0 +1,358 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ____________________________*Pipeline* : Pipelined load, build and query____________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    Pipeline.h contains a cold start that overlaps its stages instead of running them one after
+    another (read test, read train, copy, build, query):
+
+        - the training file is read by one thread while parser threads turn the blocks already read
+          into points, so the disk and the cores work at the same time;
+        - the query file is read and parsed in the background during the whole load and build;
+        - queries are answered block by block as soon as the index is published, in file order,
+          so the first answers come out while the rest of the query file may still be loading.
+
+    The build itself starts once the last training point is parsed: the split of every node
+    (median, spread, k-means of the shards) depends on all the points under it.
+
+    - Classes:
+
+        - CSVStream:
+            Description:
+                Reads a CSV file with a header row, like VectorDataset::readCSV (same handling of
+                bad cells and rows of another dimension), in blocks of about blockBytes bytes of
+                whole lines. open() starts a reader thread and threads parser threads; next()
+                returns the points of the next block in file order, waiting for it if need be. At
+                most 2 * threads blocks of text wait for a parser at any time.
+
+    - Functions:
+
+        - vector<DataVector> readCSVParallel(const string& filename, int threads):
+            Description:
+                All the points of a CSV file, parsed on workerCount(threads) threads.
+
+        - PipelineTimes runPipeline(TreeIndex& index, const string& trainfile, const string& testfile,
+                                    int k, int threads, Answer answer):
+            Description:
+                Load trainfile, build index over it and answer the k nearest neighbours of every
+                point of testfile with batch_knn, one block of queries at a time. answer(first,
+                answers) gets the answers of queries first, first + 1, ... in file order, on the
+                calling thread. Returns when each stage finished, in milliseconds since the call,
+                with no points when trainfile is empty or the build does not fit in the memory
+                budget of the index (see admitBuild).
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include "DataVector.h"
+#include "TreeIndex.h"
+#include "Trace.h"
+
+using namespace std;
+
+// Bytes per block of the training file, and of the query file (smaller, so the first queries are
+// parsed, and answered, early).
+const size_t CSVBLOCK = 1 << 20;
+const size_t QUERYBLOCK = 1 << 16;
+
+class CSVStream
+{
+    FILE *file;
+    size_t blockBytes;
+    int waiting; // most text blocks queued for the parsers
+
+    mutex lock;
+    condition_variable changed;
+    deque<pair<int, string>> text;           // blocks read, not parsed yet
+    map<int, vector<DataVector>> parsed;     // blocks parsed, not returned by next() yet
+    int blocks;                              // blocks read so far
+    int delivered;                           // blocks returned by next() so far
+    bool exhausted;                          // the reader is done
+    bool cancelled;                          // close() before the end: stop reading
+    int dim;                                 // dimension of the first point, -1 before it
+    vector<thread> workers;
+
+    void read()
+    {
+        string carry; // partial last line of the previous block
+        vector<char> buffer(blockBytes);
+        while (true)
+        {
+            size_t got = fread(buffer.data(), 1, buffer.size(), file);
+            string block;
+            block.swap(carry);
+            block.append(buffer.data(), got);
+            if (got > 0)
+            {
+                // hand over whole lines only
+                size_t end = block.rfind('\n');
+                if (end == string::npos)
+                {
+                    carry.swap(block);
+                    continue;
+                }
+                carry = block.substr(end + 1);
+                block.resize(end + 1);
+            }
+            if (!block.empty())
+            {
+                unique_lock<mutex> guard(lock);
+                changed.wait(guard, [this]() { return cancelled || (int)text.size() < waiting; });
+                if (cancelled)
+                    break;
+                text.push_back(make_pair(blocks++, move(block)));
+                changed.notify_all();
+            }
+            if (got == 0)
+            {
+                break;
+            }
+        }
+        lock_guard<mutex> guard(lock);
+        exhausted = true;
+        changed.notify_all();
+    }
+
+    void parse()
+    {
+        unique_lock<mutex> guard(lock);
+        while (true)
+        {
+            changed.wait(guard, [this]() { return exhausted || cancelled || !text.empty(); });
+            if (text.empty() || cancelled)
+            {
+                return;
+            }
+            pair<int, string> block = move(text.front());
+            text.pop_front();
+            changed.notify_all();
+            guard.unlock();
+            vector<DataVector> rows;
+            {
+                TraceSpan span("load.parse");
+                parseLines(block.second, rows);
+            }
+            guard.lock();
+            parsed[block.first].swap(rows);
+            changed.notify_all();
+        }
+    }
+
+    // One point per line, cells separated by commas. A cell that is not a number is reported and
+    // skipped, as in VectorDataset::readCSV.
+    static void parseLines(const string &block, vector<DataVector> &rows)
+    {
+        const char *p = block.c_str();
+        const char *stop = p + block.size();
+        vector<double> row;
+        while (p < stop)
+        {
+            const char *lineEnd = (const char *)memchr(p, '\n', stop - p);
+            if (lineEnd == NULL)
+                lineEnd = stop;
+            row.clear();
+            for (const char *cell = p; cell < lineEnd;)
+            {
+                const char *cellEnd = (const char *)memchr(cell, ',', lineEnd - cell);
+                if (cellEnd == NULL)
+                    cellEnd = lineEnd;
+                char *end;
+                errno = 0;
+                double value = strtod(cell, &end);
+                if (end == cell || end > cellEnd)
+                    cerr << "Invalid argument in line: " << string(p, lineEnd) << "\n";
+                else if (errno == ERANGE)
+                    cerr << "Out of range in line: " << string(p, lineEnd) << "\n";
+                else
+                    row.push_back(value);
+                cell = cellEnd + 1;
+            }
+            rows.push_back(DataVector(row));
+            p = lineEnd + 1;
+        }
+    }
+
+public:
+    CSVStream() : file(NULL), blockBytes(CSVBLOCK), waiting(2), blocks(0), delivered(0), exhausted(true), cancelled(false), dim(-1) {}
+
+    ~CSVStream()
+    {
+        close();
+    }
+
+    bool open(const string &filename, int threads, size_t bytes = CSVBLOCK)
+    {
+        close();
+        file = fopen(filename.c_str(), "rb");
+        if (file == NULL)
+        {
+            cerr << "Error opening file: " << filename << endl;
+            return false;
+        }
+        // Skip the header row
+        for (int c = fgetc(file); c != EOF && c != '\n'; c = fgetc(file))
+        {
+        }
+        threads = workerCount(threads);
+        blockBytes = max<size_t>(bytes, 1);
+        waiting = 2 * threads;
+        blocks = 0;
+        delivered = 0;
+        exhausted = false;
+        cancelled = false;
+        dim = -1;
+        text.clear();
+        parsed.clear();
+        workers.push_back(thread([this]() { read(); }));
+        for (int t = 0; t < threads; t++)
+        {
+            workers.push_back(thread([this]() { parse(); }));
+        }
+        return true;
+    }
+
+    // The points of the next block in file order; false once every block was returned.
+    bool next(vector<DataVector> &rows)
+    {
+        rows.clear();
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this]() { return parsed.count(delivered) || (exhausted && text.empty() && delivered == blocks); });
+        map<int, vector<DataVector>>::iterator block = parsed.find(delivered);
+        if (block == parsed.end())
+        {
+            return false;
+        }
+        vector<DataVector> all;
+        all.swap(block->second);
+        parsed.erase(block);
+        delivered++;
+        guard.unlock();
+
+        // Check for consistent dimension with the first point of the file
+        rows.reserve(all.size());
+        for (size_t i = 0; i < all.size(); i++)
+        {
+            if (dim < 0)
+                dim = all[i].getDimension();
+            if (all[i].getDimension() != dim)
+                cerr << "Inconsistent dimension in a line of " << all[i].getDimension() << " values\n";
+            else
+                rows.push_back(move(all[i]));
+        }
+        return true;
+    }
+
+    void close()
+    {
+        {
+            // blocks nobody asked for yet are dropped
+            lock_guard<mutex> guard(lock);
+            cancelled = true;
+            changed.notify_all();
+        }
+        for (size_t t = 0; t < workers.size(); t++)
+        {
+            workers[t].join();
+        }
+        workers.clear();
+        if (file != NULL)
+        {
+            fclose(file);
+            file = NULL;
+        }
+    }
+};
+
+inline vector<DataVector> readCSVParallel(const string &filename, int threads)
+{
+    TraceSpan span("load.csv");
+    vector<DataVector> points;
+    CSVStream stream;
+    if (!stream.open(filename, threads))
+    {
+        return points;
+    }
+    vector<DataVector> rows;
+    while (stream.next(rows))
+    {
+        points.insert(points.end(), make_move_iterator(rows.begin()), make_move_iterator(rows.end()));
+    }
+    return points;
+}
+
+// When each stage of runPipeline() finished, in milliseconds since it started.
+struct PipelineTimes
+{
+    double loaded;      // last training point parsed
+    double built;       // index published
+    double firstAnswer; // answers of the first block of queries handed to answer()
+    double answered;    // every query answered
+    int points;
+    int queries;
+
+    PipelineTimes() : loaded(0), built(0), firstAnswer(0), answered(0), points(0), queries(0) {}
+};
+
+template <class Answer>
+PipelineTimes runPipeline(TreeIndex &index, const string &trainfile, const string &testfile, int k, int threads, Answer answer)
+{
+    PipelineTimes times;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    auto elapsed = [&start]() { return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count(); };
+
+    // the queries load in the background from here on, on one parser thread
+    CSVStream queries;
+    queries.open(testfile, 1, QUERYBLOCK);
+
+    vector<DataVector> points = readCSVParallel(trainfile, threads);
+    times.loaded = elapsed();
+    times.points = points.size();
+    if (points.empty())
+    {
+        cerr << "No points in " << trainfile << endl;
+        return times;
+    }
+    if (!admitBuild(index.estimateMemory(points.size(), points[0].getDimension()), index.getParams()))
+    {
+        // reported as a load without points: nothing is built or answered
+        times.points = 0;
+        return times;
+    }
+    index.maketree(points);
+    times.built = elapsed();
+
+    vector<DataVector> block;
+    while (queries.next(block))
+    {
+        if (block.empty())
+        {
+            continue;
+        }
+        vector<vector<pair<double, int>>> answers = index.batch_knn(block, k);
+        if (times.queries == 0)
+        {
+            times.firstAnswer = elapsed();
+        }
+        answer(times.queries, answers);
+        times.queries += block.size();
+    }
+    times.answered = elapsed();
+    return times;
+}
+
+#endif
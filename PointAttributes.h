@@ -0,0 +1,166 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ______________________*PointAttributes* : Per-point labels and tenants______________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    PointAttributes.h contains the metadata filtered searches (TreeIndex::filtered_knn) select points
+    by, stored column-wise next to the dataset: point i (the point of id i) has a set of labels 0..63,
+    kept as one 64-bit mask, and a tenant id.
+
+    - Classes:
+
+        - PointAttributes:
+            Description:
+                The two columns. add() appends the attributes of the next point, erase() removes the
+                ones of a point; the caller keeps them in step with the points across AddData /
+                DeleteData. readCSV() reads one line per point: the tenant, a comma, then the labels
+                separated by spaces (e.g. "7,0 3 12").
+
+        - AttributeSummary:
+            Description:
+                What a node of a tree knows about the points under it: the union of their labels and
+                a 64-bit bitmap of their tenants (bit tenant % 64). Built once with the tree; a
+                subtree whose summary can not satisfy a filter is skipped without being visited.
+
+        - PointFilter:
+            Description:
+                The predicate: every label of allLabels, at least one label of anyLabels (if not 0)
+                and the given tenant (if not -1). matches() tests one point; mayMatch() tests a
+                summary, conservatively (a summary that may match can still hold no match).
+*/
+
+#ifndef POINTATTRIBUTES_H
+#define POINTATTRIBUTES_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace std;
+
+struct AttributeSummary
+{
+    uint64_t labels;
+    uint64_t tenants;
+
+    AttributeSummary() : labels(0), tenants(0) {}
+
+    void add(const AttributeSummary &other)
+    {
+        labels |= other.labels;
+        tenants |= other.tenants;
+    }
+};
+
+class PointAttributes
+{
+    vector<uint64_t> labels;
+    vector<int> tenants;
+
+public:
+    int size() const
+    {
+        return labels.size();
+    }
+
+    void add(uint64_t labelMask, int tenant)
+    {
+        labels.push_back(labelMask);
+        tenants.push_back(tenant);
+    }
+
+    void erase(int id)
+    {
+        labels.erase(labels.begin() + id);
+        tenants.erase(tenants.begin() + id);
+    }
+
+    uint64_t labelsOf(int id) const
+    {
+        return labels[id];
+    }
+
+    int tenantOf(int id) const
+    {
+        return tenants[id];
+    }
+
+    static uint64_t tenantBit(int tenant)
+    {
+        return 1ULL << ((unsigned)tenant & 63);
+    }
+
+    AttributeSummary summary(int id) const
+    {
+        AttributeSummary s;
+        if (id < size())
+        {
+            s.labels = labels[id];
+            s.tenants = tenantBit(tenants[id]);
+        }
+        return s;
+    }
+
+    bool readCSV(const string &filename)
+    {
+        ifstream file(filename);
+        if (!file.is_open())
+        {
+            cerr << "Error opening file: " << filename << endl;
+            return false;
+        }
+        labels.clear();
+        tenants.clear();
+        string line;
+        while (getline(file, line))
+        {
+            size_t comma = line.find(',');
+            int tenant = atoi(line.substr(0, comma).c_str());
+            uint64_t mask = 0;
+            if (comma != string::npos)
+            {
+                istringstream rest(line.substr(comma + 1));
+                int label;
+                while (rest >> label)
+                {
+                    if (label >= 0 && label < 64)
+                        mask |= 1ULL << label;
+                }
+            }
+            add(mask, tenant);
+        }
+        return true;
+    }
+};
+
+struct PointFilter
+{
+    uint64_t allLabels; // labels a point must all have
+    uint64_t anyLabels; // a point must have one of these, 0 for no constraint
+    int tenant;         // tenant a point must belong to, -1 for any
+
+    PointFilter() : allLabels(0), anyLabels(0), tenant(-1) {}
+
+    bool matches(const PointAttributes &attributes, int id) const
+    {
+        if (id >= attributes.size())
+        {
+            return false;
+        }
+        uint64_t labels = attributes.labelsOf(id);
+        return (labels & allLabels) == allLabels && (anyLabels == 0 || (labels & anyLabels) != 0) &&
+               (tenant < 0 || attributes.tenantOf(id) == tenant);
+    }
+
+    bool mayMatch(const AttributeSummary &summary) const
+    {
+        return (summary.labels & allLabels) == allLabels && (anyLabels == 0 || (summary.labels & anyLabels) != 0) &&
+               (tenant < 0 || (summary.tenants & PointAttributes::tenantBit(tenant)) != 0);
+    }
+};
+
+#endif
@@ -0,0 +1,369 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ___________________________*QueryCache* : The CachedIndex class___________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    QueryCache.h contains CachedIndex, a TreeIndex that sits in front of another index and remembers
+    the answers of recent queries, so repeated (or, optionally, nearly repeated) queries skip the
+    search.
+
+    - Keys: by default the exact query vector (and k). With IndexParams::cacheStep > 0 the query is
+      first snapped to a grid of that step, so queries that fall in the same cell share an answer;
+      the answer is then the one of the first query of the cell, which is approximate.
+    - Bounded: IndexParams::cacheSize entries in total, evicted with the CLOCK rule (an entry that
+      was hit since the hand last passed gets a second chance). 0 turns the cache off.
+    - Sharded: entries are spread by hash over SHARDS shards, each with its own lock, so parallel
+      queries rarely wait on each other.
+    - Invalidated by maketree, AddData, DeleteData and setParams: every entry records the generation
+      of the index it was computed on, and a bump of the generation makes them all misses at once.
+      An answer computed while an update runs is stored under the old generation, so it is never
+      served afterwards.
+
+    The cache size and step are fixed when the CachedIndex is constructed; setParams passes the rest
+    on to the index.
+
+    - Member Functions (besides the TreeIndex ones):
+
+        - uint64_t hits() const, uint64_t misses() const:
+            Description:
+                Number of lookups answered from / not found in the cache since construction.
+*/
+
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include "DataVector.h"
+#include "TreeIndex.h"
+
+using namespace std;
+
+class CachedIndex : public TreeIndex
+{
+    static const int SHARDS = 16;
+
+    enum Kind
+    {
+        CANDIDATES, // query_search
+        NEAREST     // knn, batch_knn
+    };
+
+    struct Entry
+    {
+        uint64_t hash;
+        uint64_t generation;
+        vector<double> key; // the query, or its grid cell
+        int k;
+        int kind;
+        bool referenced;
+        vector<pair<double, int>> nearest;
+        vector<DataVector> candidates;
+    };
+
+    struct Shard
+    {
+        mutex lock;
+        vector<Entry> entries;
+        unordered_map<uint64_t, int> slots; // hash -> entry
+        size_t hand;
+
+        Shard() : hand(0) {}
+    };
+
+    TreeIndex &index;
+    size_t shardCapacity;
+    double step;
+    mutable vector<Shard> shards;
+    atomic<uint64_t> generation;
+    mutable atomic<uint64_t> hitCount, missCount;
+
+    // The key of a query: the values themselves, or the grid cell they fall in.
+    vector<double> keyOf(const DataVector &point) const
+    {
+        vector<double> key = point.getVector();
+        if (step > 0)
+        {
+            for (size_t i = 0; i < key.size(); i++)
+            {
+                key[i] = floor(key[i] / step);
+            }
+        }
+        return key;
+    }
+
+    // FNV-1a over the bytes of the key, k and kind.
+    static uint64_t hashOf(const vector<double> &key, int k, int kind)
+    {
+        uint64_t hash = 1469598103934665603ULL;
+        auto mix = [&hash](const void *data, size_t bytes) {
+            const unsigned char *p = (const unsigned char *)data;
+            for (size_t i = 0; i < bytes; i++)
+            {
+                hash = (hash ^ p[i]) * 1099511628211ULL;
+            }
+        };
+        mix(key.data(), key.size() * sizeof(double));
+        mix(&k, sizeof(k));
+        mix(&kind, sizeof(kind));
+        return hash;
+    }
+
+    Shard &shardOf(uint64_t hash) const
+    {
+        return shards[(hash >> 32) % SHARDS];
+    }
+
+    // The live entry for (key, k, kind), NULL if there is none. Called with the shard locked.
+    const Entry *find(Shard &shard, uint64_t hash, const vector<double> &key, int k, int kind) const
+    {
+        auto it = shard.slots.find(hash);
+        if (it == shard.slots.end())
+        {
+            return NULL;
+        }
+        Entry &entry = shard.entries[it->second];
+        if (entry.generation != generation.load() || entry.k != k || entry.kind != kind || entry.key != key)
+        {
+            return NULL;
+        }
+        entry.referenced = true;
+        return &entry;
+    }
+
+    // The slot an entry for hash goes to: its current one, a free one, or the first one the CLOCK
+    // hand finds unreferenced. Called with the shard locked.
+    Entry &slotFor(Shard &shard, uint64_t hash) const
+    {
+        auto it = shard.slots.find(hash);
+        if (it != shard.slots.end())
+        {
+            return shard.entries[it->second];
+        }
+        int slot;
+        if (shard.entries.size() < shardCapacity)
+        {
+            slot = shard.entries.size();
+            shard.entries.push_back(Entry());
+        }
+        else
+        {
+            while (shard.entries[shard.hand].referenced && shard.entries[shard.hand].generation == generation.load())
+            {
+                shard.entries[shard.hand].referenced = false;
+                shard.hand = (shard.hand + 1) % shard.entries.size();
+            }
+            slot = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.entries.size();
+            shard.slots.erase(shard.entries[slot].hash);
+        }
+        shard.slots[hash] = slot;
+        Entry &entry = shard.entries[slot];
+        entry.hash = hash;
+        return entry;
+    }
+
+    bool lookup(const vector<double> &key, int k, vector<pair<double, int>> &answer) const
+    {
+        uint64_t hash = hashOf(key, k, NEAREST);
+        Shard &shard = shardOf(hash);
+        lock_guard<mutex> lock(shard.lock);
+        const Entry *entry = find(shard, hash, key, k, NEAREST);
+        if (entry == NULL)
+        {
+            missCount++;
+            return false;
+        }
+        hitCount++;
+        answer = entry->nearest;
+        return true;
+    }
+
+    void store(const vector<double> &key, int k, uint64_t computedAt, const vector<pair<double, int>> &answer) const
+    {
+        uint64_t hash = hashOf(key, k, NEAREST);
+        Shard &shard = shardOf(hash);
+        lock_guard<mutex> lock(shard.lock);
+        Entry &entry = slotFor(shard, hash);
+        entry.generation = computedAt;
+        entry.key = key;
+        entry.k = k;
+        entry.kind = NEAREST;
+        entry.referenced = false;
+        entry.nearest = answer;
+        entry.candidates.clear();
+    }
+
+    void invalidate()
+    {
+        generation++;
+    }
+
+public:
+    CachedIndex(TreeIndex &index, const IndexParams &params = IndexParams())
+        : index(index), shardCapacity((max(0, params.cacheSize) + SHARDS - 1) / SHARDS), step(params.cacheStep),
+          shards(SHARDS), generation(0), hitCount(0), missCount(0) {}
+
+    uint64_t hits() const
+    {
+        return hitCount;
+    }
+
+    uint64_t misses() const
+    {
+        return missCount;
+    }
+
+    vector<DataVector> query_search(const DataVector &point, int k) const
+    {
+        if (shardCapacity == 0)
+        {
+            return index.query_search(point, k);
+        }
+        vector<double> key = keyOf(point);
+        uint64_t hash = hashOf(key, k, CANDIDATES);
+        Shard &shard = shardOf(hash);
+        {
+            lock_guard<mutex> lock(shard.lock);
+            const Entry *entry = find(shard, hash, key, k, CANDIDATES);
+            if (entry != NULL)
+            {
+                hitCount++;
+                return entry->candidates;
+            }
+        }
+        missCount++;
+
+        uint64_t computedAt = generation;
+        vector<DataVector> candidates = index.query_search(point, k);
+
+        lock_guard<mutex> lock(shard.lock);
+        Entry &entry = slotFor(shard, hash);
+        entry.generation = computedAt;
+        entry.key = key;
+        entry.k = k;
+        entry.kind = CANDIDATES;
+        entry.referenced = false;
+        entry.nearest.clear();
+        entry.candidates = candidates;
+        return candidates;
+    }
+
+    vector<pair<double, int>> knn(const DataVector &point, int k) const
+    {
+        if (shardCapacity == 0)
+        {
+            return index.knn(point, k);
+        }
+        vector<double> key = keyOf(point);
+        vector<pair<double, int>> answer;
+        if (lookup(key, k, answer))
+        {
+            return answer;
+        }
+        uint64_t computedAt = generation;
+        answer = index.knn(point, k);
+        store(key, k, computedAt, answer);
+        return answer;
+    }
+
+    // Answers the cached queries of the batch directly and sends the others to the index as one
+    // smaller batch.
+    vector<vector<pair<double, int>>> batch_knn(const vector<DataVector> &queries, int k) const
+    {
+        if (shardCapacity == 0)
+        {
+            return index.batch_knn(queries, k);
+        }
+        vector<vector<pair<double, int>>> answers(queries.size());
+        vector<vector<double>> keys(queries.size());
+        vector<DataVector> missed;
+        vector<int> missedAt;
+        for (size_t q = 0; q < queries.size(); q++)
+        {
+            keys[q] = keyOf(queries[q]);
+            if (!lookup(keys[q], k, answers[q]))
+            {
+                missed.push_back(queries[q]);
+                missedAt.push_back(q);
+            }
+        }
+        if (missed.empty())
+        {
+            return answers;
+        }
+
+        uint64_t computedAt = generation;
+        vector<vector<pair<double, int>>> computed = index.batch_knn(missed, k);
+        for (size_t m = 0; m < missed.size(); m++)
+        {
+            answers[missedAt[m]] = computed[m];
+            store(keys[missedAt[m]], k, computedAt, computed[m]);
+        }
+        return answers;
+    }
+
+    // Filtered answers are not cached: the filter is not part of the key.
+    vector<pair<double, int>> filtered_knn(const DataVector &point, int k, const PointFilter &filter) const
+    {
+        return index.filtered_knn(point, k, filter);
+    }
+
+    void setAttributes(shared_ptr<const PointAttributes> attributes)
+    {
+        index.setAttributes(attributes);
+    }
+
+    void setParams(const IndexParams &params)
+    {
+        index.setParams(params);
+        invalidate();
+    }
+
+    IndexParams getParams() const
+    {
+        return index.getParams();
+    }
+
+    // The estimate of the index, and a full cache of knn answers on top (query_search candidates are
+    // not counted). Only the index checks its part when it builds.
+    MemoryEstimate estimateMemory(size_t points, int dim) const
+    {
+        // neighbours per cached answer, and bytes per entry of the slot map
+        const size_t ANSWER = 10, SLOT = 32;
+        MemoryEstimate memory = index.estimateMemory(points, dim);
+        memory.caches += shardCapacity * SHARDS * (sizeof(Entry) + dim * sizeof(double) + ANSWER * sizeof(pair<double, int>) + SLOT);
+        return memory;
+    }
+
+    bool maketree(const vector<DataVector> &points)
+    {
+        bool built = index.maketree(points);
+        invalidate();
+        return built;
+    }
+
+    //AddData
+    bool AddData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        bool built = index.AddData(newpoint, points);
+        invalidate();
+        return built;
+    }
+
+    //DeleteData
+    bool DeleteData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        bool built = index.DeleteData(newpoint, points);
+        invalidate();
+        return built;
+    }
+};
+
+#endif
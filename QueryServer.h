@@ -0,0 +1,270 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ___________________________*QueryServer* : Long-running query service___________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    QueryServer.h contains the parts of the server (server.cpp) that answer k-NN requests against an
+    index built once: the wire protocol, the micro-batcher and the connection loop.
+
+    Protocol (binary, native byte order), any number of requests per connection:
+        - request:  uint32 id, uint32 k, uint32 dim, then dim doubles (the query).
+        - response: uint32 id, uint32 count, then count times (double distance, int32 id of the
+                    neighbour in the indexed points), nearest first.
+    Responses carry the id of their request and may come back in any order, so a client can keep
+    several requests in flight on one connection.
+
+    - Classes:
+
+        - QueryBatcher(TreeIndex& index, int batchSize, int batchWait):
+            Description:
+                Collects requests from every connection and answers them with batch_knn. A batch is
+                sent as soon as batchSize requests are waiting, or batchWait microseconds after the
+                first of them arrived, whichever comes first; requests of a batch with different k
+                go to one batch_knn call per k. Replies are sent from the batcher's own thread, so
+                the connection that submitted a request goes on reading the next one meanwhile. A
+                batch_knn call that throws gets its requests empty answers, with a note on cerr.
+
+    - Functions:
+
+        - void serveConnection(int in, int out, QueryBatcher& batcher, int dim, int points, bool owned):
+            Description:
+                Read requests from the file descriptor in until it is closed, submitting them to
+                batcher, with replies written to out. A request with k = 0, or k above the points
+                indexed or MAXREQUESTK, gets an empty answer; one whose dimension is not dim gets an
+                empty answer and ends the connection. Closes the descriptors once every reply is
+                written if owned.
+*/
+
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <exception>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include "DataVector.h"
+#include "TreeIndex.h"
+
+using namespace std;
+
+// Largest k a request may ask for.
+const uint32_t MAXREQUESTK = 1 << 16;
+
+// read() / write() exactly bytes, across partial transfers. false on end of file or error.
+inline bool readFull(int fd, void *data, size_t bytes)
+{
+    char *p = (char *)data;
+    while (bytes > 0)
+    {
+        ssize_t got = read(fd, p, bytes);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        p += got;
+        bytes -= got;
+    }
+    return true;
+}
+
+inline bool writeFull(int fd, const void *data, size_t bytes)
+{
+    const char *p = (const char *)data;
+    while (bytes > 0)
+    {
+        ssize_t put = write(fd, p, bytes);
+        if (put < 0 && errno == EINTR)
+            continue;
+        if (put <= 0)
+            return false;
+        p += put;
+        bytes -= put;
+    }
+    return true;
+}
+
+class QueryBatcher
+{
+public:
+    typedef function<void(const vector<pair<double, int>> &)> Reply;
+
+private:
+    struct Request
+    {
+        DataVector query;
+        int k;
+        Reply reply;
+    };
+
+    TreeIndex &index;
+    int batchSize;
+    chrono::microseconds batchWait;
+
+    mutex lock;
+    condition_variable arrived;
+    deque<Request> waiting;
+    bool stopping;
+    thread worker;
+
+    void run()
+    {
+        vector<Request> batch;
+        while (true)
+        {
+            {
+                unique_lock<mutex> guard(lock);
+                arrived.wait(guard, [this]() { return stopping || !waiting.empty(); });
+                if (waiting.empty())
+                {
+                    return;
+                }
+                // give the batch a moment to fill up, unless it already has
+                auto deadline = chrono::steady_clock::now() + batchWait;
+                arrived.wait_until(guard, deadline, [this]() { return stopping || (int)waiting.size() >= batchSize; });
+
+                while (!waiting.empty() && (int)batch.size() < batchSize)
+                {
+                    batch.push_back(move(waiting.front()));
+                    waiting.pop_front();
+                }
+            }
+
+            map<int, vector<int>> byK;
+            for (size_t r = 0; r < batch.size(); r++)
+            {
+                byK[batch[r].k].push_back(r);
+            }
+            for (auto it = byK.begin(); it != byK.end(); it++)
+            {
+                vector<DataVector> queries;
+                for (size_t i = 0; i < it->second.size(); i++)
+                {
+                    queries.push_back(batch[it->second[i]].query);
+                }
+                vector<vector<pair<double, int>>> answers;
+                try
+                {
+                    answers = index.batch_knn(queries, it->first);
+                }
+                catch (const exception &error)
+                {
+                    cerr << "Batch of " << queries.size() << " queries failed: " << error.what() << endl;
+                }
+                answers.resize(queries.size());
+                for (size_t i = 0; i < it->second.size(); i++)
+                {
+                    batch[it->second[i]].reply(answers[i]);
+                }
+            }
+            // a reply holds its connection open, let go of them
+            batch.clear();
+        }
+    }
+
+public:
+    QueryBatcher(TreeIndex &index, int batchSize = 64, int batchWait = 200)
+        : index(index), batchSize(max(1, batchSize)), batchWait(max(0, batchWait)), stopping(false)
+    {
+        worker = thread([this]() { run(); });
+    }
+
+    // Answers every request already submitted, then stops.
+    ~QueryBatcher()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        arrived.notify_all();
+        worker.join();
+    }
+
+    void submit(const DataVector &query, int k, Reply reply)
+    {
+        Request request = {query, k, reply};
+        {
+            lock_guard<mutex> guard(lock);
+            waiting.push_back(move(request));
+        }
+        arrived.notify_one();
+    }
+};
+
+// One client: replies of several batches may be written concurrently, so writes are serialized,
+// and the descriptors are closed when the reader and the last pending reply let go of it.
+struct Connection
+{
+    int in, out;
+    bool owned;
+    mutex writing;
+
+    Connection(int in, int out, bool owned) : in(in), out(out), owned(owned) {}
+
+    ~Connection()
+    {
+        if (owned)
+        {
+            close(in);
+            if (out != in)
+                close(out);
+        }
+    }
+};
+
+inline void serveConnection(int in, int out, QueryBatcher &batcher, int dim, int points, bool owned)
+{
+    shared_ptr<Connection> connection = make_shared<Connection>(in, out, owned);
+    uint32_t header[3];
+    vector<double> values;
+    while (readFull(in, header, sizeof(header)))
+    {
+        uint32_t id = header[0];
+        QueryBatcher::Reply reply = [connection, id](const vector<pair<double, int>> &answer) {
+            vector<char> message(2 * sizeof(uint32_t) + answer.size() * (sizeof(double) + sizeof(int32_t)));
+            uint32_t head[2] = {id, (uint32_t)answer.size()};
+            char *p = message.data();
+            memcpy(p, head, sizeof(head));
+            p += sizeof(head);
+            for (size_t i = 0; i < answer.size(); i++)
+            {
+                int32_t neighbour = answer[i].second;
+                memcpy(p, &answer[i].first, sizeof(double));
+                memcpy(p + sizeof(double), &neighbour, sizeof(int32_t));
+                p += sizeof(double) + sizeof(int32_t);
+            }
+            lock_guard<mutex> guard(connection->writing);
+            writeFull(connection->out, message.data(), message.size());
+        };
+
+        if ((int)header[2] != dim)
+        {
+            // the rest of the stream can not be trusted to be framed the way we think
+            reply(vector<pair<double, int>>());
+            break;
+        }
+        values.resize(dim);
+        if (!readFull(in, values.data(), values.size() * sizeof(double)))
+        {
+            break;
+        }
+        if (header[1] == 0 || header[1] > (uint32_t)max(0, points) || header[1] > MAXREQUESTK)
+        {
+            reply(vector<pair<double, int>>());
+            continue;
+        }
+        batcher.submit(DataVector(values), header[1], reply);
+    }
+}
+
+#endif
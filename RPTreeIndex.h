@@ -0,0 +1,616 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ___________________________*RPTreeIndex* : The RPTreeIndex class___________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    RPTreeIndex.h contains the random projection tree index. Every internal node projects its points
+    onto a random unit direction and splits them at the (jittered) median projection; leaves hold at
+    most IndexParams::leafSize points. With IndexParams::numTrees > 1 the index is a forest of
+    independently built trees and a query searches the union of their candidates.
+
+    The tree keeps its points in one flat buffer (TreePoints) laid out in tree order, so a node only
+    stores the row range of its points. Nodes and split directions come from the tree's NodeArenas.
+    With IndexParams::leafBlocks the leaves of the first tree start on multiples of LEAFBLOCK rows and
+    are scanned a dimension-major block at a time, as in KDTreeIndex; the other trees of a forest
+    reach their rows through their order, one row at a time.
+
+    With point attributes attached (setAttributes), every node of every tree keeps the
+    AttributeSummary of its points, and filtered_knn gathers its candidates as knn does, but skips the
+    subtrees whose summary rules the filter out and only takes the points of a leaf that match.
+
+    The built tree (RPTree) is immutable and published through a Snapshot, so queries run
+    concurrently with AddData / DeleteData and never wait for a build (see the concurrency model in
+    TreeIndex.h).
+*/
+
+#ifndef RPTREEINDEX_H
+#define RPTREEINDEX_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include "DataVector.h"
+#include "TreeIndex.h"
+#include "NodeArena.h"
+#include "DistanceKernels.h"
+#include "BatchQuery.h"
+
+using namespace std;
+
+struct RPNode
+{
+    RPNode* left;
+    RPNode* right;
+    double medianval;
+    const double* axis; // NULL in leaves
+    int begin, end; // rows of the tree's points under this node
+    AttributeSummary summary; // of the points under this node, with attributes
+};
+
+// A fully built forest of RP-trees over the same points. Never modified once published.
+struct RPTree
+{
+    TreePoints points; // rows in the order of the first tree
+    NodeArena<RPNode> nodes;
+    NodeArena<double> axes;
+    vector<RPNode*> roots;
+    // orders[t][i] is the row of the i-th point of tree t. Empty for the first tree, whose order is
+    // the row order.
+    vector<vector<int>> orders;
+    int leafSize;
+    int leafAlign; // every leaf of the first tree starts on a multiple of this row (see leafAlignment)
+    shared_ptr<const PointAttributes> attributes; // those the node summaries were built from
+
+    RPTree() : axes(1 << 16), leafSize(MINSIZE), leafAlign(1) {}
+};
+
+class RPTreeIndex : public TreeIndex
+{
+    Snapshot<RPTree> snapshot;
+    mutable mutex writer;
+    shared_ptr<RPTree> published, retired;
+    IndexParams params;
+    atomic<int> searchBudget;
+
+    // generate random dimension
+    static void randomUnitDirection(mt19937 &gen, double *direction, size_t dimensions) {
+        uniform_real_distribution<double> dis(-1.0, 1.0);
+
+        double sum = 0.0;
+        for (size_t i = 0; i < dimensions; ++i) {
+            direction[i] = dis(gen);
+            sum += direction[i] * direction[i];
+        }
+        double norm = sqrt(sum);
+        for (size_t i = 0; i < dimensions; ++i) {
+            direction[i] /= norm;
+        }
+    }
+
+    static int randomX(mt19937 &gen, int k){
+        return uniform_int_distribution<int>(0, k - 1)(gen);
+    }
+
+    // initial call to build tree
+    static void buildTree(RPTree &tree, const vector<DataVector>& points, const IndexParams &params)
+    {
+        TraceSpan span("rp.build");
+        tree.nodes.reset();
+        tree.axes.reset();
+        tree.nodes.setHugePages(params.hugePages);
+        tree.axes.setHugePages(params.hugePages);
+        tree.points.setHugePages(params.hugePages);
+        tree.roots.clear();
+        tree.orders.clear();
+        tree.leafSize = leafCapacity(params);
+        tree.leafAlign = leafAlignment(params);
+        tree.points.load(points);
+        if (points.empty())
+        {
+            return;
+        }
+
+        random_device rd;
+        mt19937 gen(rd());
+        vector<pair<double, int>> keys(points.size());
+        for (int t = 0; t < max(1, params.numTrees); t++)
+        {
+            vector<int> order(points.size());
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                order[i] = i;
+            }
+            tree.roots.push_back(buildTree(tree, gen, order, keys, 0, order.size()));
+            if (t == 0)
+            {
+                // lay the rows out in the order of the first tree, so its nodes' points are contiguous
+                tree.points.permute(order);
+                tree.orders.push_back(vector<int>());
+            }
+            else
+            {
+                tree.orders.push_back(order);
+            }
+        }
+        if (tree.attributes)
+        {
+            for (size_t t = 0; t < tree.roots.size(); t++)
+            {
+                summarize(tree, tree.orders[t], tree.roots[t]);
+            }
+        }
+        TraceSpan finish("rp.finish");
+        tree.points.finish(params.storage, params.rerank, params.pqSubspaces, params.varianceOrder, params.leafBlocks);
+    }
+
+    // Fill in the attribute summaries of node and its subtree, in a tree with the given order.
+    static const AttributeSummary &summarize(RPTree &tree, const vector<int> &order, RPNode *node)
+    {
+        node->summary = AttributeSummary();
+        if (node->left == NULL)
+        {
+            for (int i = node->begin; i < node->end; i++)
+            {
+                node->summary.add(tree.attributes->summary(tree.points.ids[rowOf(order, i)]));
+            }
+        }
+        else
+        {
+            node->summary.add(summarize(tree, order, node->left));
+            node->summary.add(summarize(tree, order, node->right));
+        }
+        return node->summary;
+    }
+
+    // Overloaded buildTree function for a range of order (actual implementation). keys is scratch
+    // space of the same length as order.
+    static RPNode *buildTree(RPTree &tree, mt19937 &gen, vector<int> &order, vector<pair<double, int>> &keys, int begin, int end)
+    {
+        const TreePoints &points = tree.points;
+        int k = points.dim;
+        //Here k is dimension
+
+        RPNode *newnode = tree.nodes.allocate();
+        newnode->begin = begin;
+        newnode->end = end;
+
+        if (end - begin <= tree.leafSize)
+        {
+            newnode->left = NULL;
+            newnode->right = NULL;
+            newnode->medianval = -1;
+            newnode->axis = NULL;
+            return newnode;
+        }
+
+        double *axis = tree.axes.allocate(k);
+        randomUnitDirection(gen, axis, k);
+        newnode->axis = axis;
+
+        const double *x = points.row(order[begin + randomX(gen, end - begin)]);
+
+        const double *y = x;
+        double maxdist = 0;
+
+        // one pass over the points: look for y and project every point on axis exactly once
+        for (int it = begin; it != end; it++)
+        {
+            const double *p = points.row(order[it]);
+            double dist = dotProduct(p, x, k);
+            if(dist > maxdist){
+                maxdist = dist;
+                y = p;
+            }
+            keys[it] = make_pair(dotProduct(p, axis, k), order[it]);
+        }
+
+        uniform_real_distribution<double> dis(-1.0, 1.0);
+        double delta = dis(gen)*6*sqrt(squaredDistance(x, y, k))/sqrt(k);
+
+        // split at the median projection; neither half has to be sorted
+        int split = medianSplit(begin, end, tree.leafAlign);
+        nth_element(keys.begin() + begin, keys.begin() + split - 1, keys.begin() + end);
+        for (int it = begin; it != end; it++)
+        {
+            order[it] = keys[it].second;
+        }
+
+        newnode->medianval = keys[split - 1].first + delta;
+        newnode->left = buildTree(tree, gen, order, keys, begin, split);
+        newnode->right = buildTree(tree, gen, order, keys, split, end);
+
+        return newnode;
+    }
+    // Row of the i-th point of a tree with the given order.
+    static int rowOf(const vector<int> &order, int i)
+    {
+        return order.empty() ? i : order[i];
+    }
+
+    // Returns the rows of the candidate neighbours of point in one tree. A sibling subtree is only
+    // added while the candidates stay within budget (0 for no limit), unless there are fewer than k.
+    static vector<int> search(const TreePoints &points, const vector<int> &order, const StoreQuery &query, const RPNode* node, int k=1, int budget=0)
+    {
+        const double *point = query.f64;
+        vector<int> nneighbours;
+        if (node == NULL)
+        {
+            return nneighbours;
+        }
+        if (node->left == NULL)
+        {
+            for (int i = node->begin; i < node->end; i++)
+            {
+                nneighbours.push_back(rowOf(order, i));
+            }
+            return nneighbours;
+        }
+
+        // the query is projected on each visited node's axis once, for both the descent and the test
+        double compareval = dotProduct(point, node->axis, points.dim);
+        const RPNode *sibling;
+        if (compareval <= node->medianval)
+        {
+            nneighbours = search(points, order, query, node->left,k,budget);
+            sibling = node->right;
+        }
+        else
+        {
+            nneighbours = search(points, order, query, node->right,k,budget);
+            sibling = node->left;
+        }
+
+        //if the distance of the given point from the farthest point in the current subtree is less than the perpendicular distance of the given point from the median, then return the left subtree else return the current node
+        double maxdist = points.farthest(query, nneighbours);
+        double mediandist = abs(node->medianval - compareval);
+
+        bool affordable = budget <= 0 || (int)nneighbours.size() + sibling->end - sibling->begin <= budget;
+
+        if ((maxdist > mediandist * mediandist && affordable) || (int)nneighbours.size() < k) {
+            for (int i = sibling->begin; i < sibling->end; i++)
+            {
+                nneighbours.push_back(rowOf(order, i));
+            }
+        }
+        return nneighbours;
+
+    }
+
+    // Adds the rows under node that match filter to rows, skipping the subtrees whose summary rules
+    // the filter out.
+    static void collect(const RPTree &tree, const vector<int> &order, const RPNode *node, const PointFilter &filter,
+                        vector<int> &rows)
+    {
+        if (!filter.mayMatch(node->summary))
+        {
+            return;
+        }
+        if (node->left == NULL)
+        {
+            for (int i = node->begin; i < node->end; i++)
+            {
+                int row = rowOf(order, i);
+                if (filter.matches(*tree.attributes, tree.points.ids[row]))
+                    rows.push_back(row);
+            }
+            return;
+        }
+        collect(tree, order, node->left, filter, rows);
+        collect(tree, order, node->right, filter, rows);
+    }
+
+    // search() among the rows that match filter: the rows of a leaf or sibling subtree are the
+    // matching ones (see collect), and fewer than k of them make the search take in the sibling.
+    static vector<int> filteredSearch(const RPTree &tree, const vector<int> &order, const StoreQuery &query, const RPNode *node,
+                                      const PointFilter &filter, int k, int budget)
+    {
+        const TreePoints &points = tree.points;
+        vector<int> nneighbours;
+        if (node->left == NULL || !filter.mayMatch(node->summary))
+        {
+            collect(tree, order, node, filter, nneighbours);
+            return nneighbours;
+        }
+
+        double compareval = dotProduct(query.f64, node->axis, points.dim);
+        const RPNode *sibling;
+        if (compareval <= node->medianval)
+        {
+            nneighbours = filteredSearch(tree, order, query, node->left, filter, k, budget);
+            sibling = node->right;
+        }
+        else
+        {
+            nneighbours = filteredSearch(tree, order, query, node->right, filter, k, budget);
+            sibling = node->left;
+        }
+
+        double maxdist = points.farthest(query, nneighbours);
+        double mediandist = abs(node->medianval - compareval);
+        bool affordable = budget <= 0 || (int)nneighbours.size() + sibling->end - sibling->begin <= budget;
+        if ((maxdist > mediandist * mediandist && affordable) || (int)nneighbours.size() < k)
+        {
+            collect(tree, order, sibling, filter, nneighbours);
+        }
+        return nneighbours;
+    }
+
+    // Upper bound of the memory of a build over n points of dimension dim (see TreeIndex::estimateMemory).
+    static MemoryEstimate estimate(size_t n, int dim, const IndexParams &params)
+    {
+        MemoryEstimate memory = TreePoints::estimate(n, dim, params, params.leafBlocks);
+        size_t trees = max(1, params.numTrees);
+        size_t nodes = treeNodes(n, leafCapacity(params));
+        // every internal node, about half of them, stores its direction
+        memory.nodes = trees * nodes * (sizeof(RPNode) + dim * sizeof(double) / 2) + hugePageSlack(params, 2);
+        // the orders of the trees after the first, and the order and sort keys of the build
+        memory.ids += (trees - 1) * n * sizeof(int) + n * (sizeof(int) + sizeof(pair<double, int>));
+        return memory;
+    }
+
+    // Build a tree over points off to the side and make it the current version, unless it does not
+    // fit in the memory budget, in which case it returns false.
+    bool rebuild(const vector<DataVector> &points)
+    {
+        if (!admitBuild(estimate(points.size(), points.empty() ? 0 : points[0].getDimension(), params), params))
+        {
+            return false;
+        }
+        // Recycle the tree retired by the previous update if no reader holds it any more: it is no
+        // longer published, so nobody can pin it again, and resetting its arenas frees every node at once.
+        shared_ptr<RPTree> tree;
+        if (retired && retired.use_count() == 1)
+        {
+            atomic_thread_fence(memory_order_acquire);
+            tree.swap(retired);
+        }
+        else
+        {
+            tree = make_shared<RPTree>();
+        }
+        retired.reset();
+
+        tree->attributes = pinAttributes();
+        buildTree(*tree, points, params);
+        snapshot.publish(tree);
+
+        retired = published;
+        published = tree;
+        return true;
+    }
+
+    // Union of the candidate rows of every tree of the forest; only the ones that match filter, if
+    // not NULL (see filteredSearch).
+    vector<int> searchForest(const RPTree &tree, const double *point, int k, const PointFilter *filter = NULL) const
+    {
+        int budget = searchBudget;
+        StoreQuery query = tree.points.store.prepare(point);
+        auto searchTree = [&](size_t t) {
+            return filter == NULL ? search(tree.points, tree.orders[t], query, tree.roots[t], k, budget)
+                                  : filteredSearch(tree, tree.orders[t], query, tree.roots[t], *filter, k, budget);
+        };
+        if (tree.roots.size() == 1)
+        {
+            return searchTree(0);
+        }
+
+        vector<int> rows;
+        for (size_t t = 0; t < tree.roots.size(); t++)
+        {
+            vector<int> found = searchTree(t);
+            rows.insert(rows.end(), found.begin(), found.end());
+        }
+        sort(rows.begin(), rows.end());
+        rows.erase(unique(rows.begin(), rows.end()), rows.end());
+        return rows;
+    }
+
+public:
+    RPTreeIndex(const IndexParams &params = IndexParams()) : params(params), searchBudget(params.searchBudget) {}
+
+    vector<DataVector> query_search(const DataVector &point, int k) const
+    {
+        shared_ptr<const RPTree> tree = snapshot.pin();
+        if (!tree || tree->roots.empty())
+        {
+            return vector<DataVector>();
+        }
+        vector<double> query = point.getVector();
+        vector<int> rows;
+        {
+            TraceSpan span("rp.search");
+            rows = searchForest(*tree, query.data(), k);
+        }
+
+        vector<DataVector> candidates;
+        candidates.reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            candidates.push_back(tree->points.get(rows[i]));
+        }
+        return candidates;
+    }
+
+    vector<pair<double, int>> knn(const DataVector &point, int k) const
+    {
+        shared_ptr<const RPTree> tree = snapshot.pin();
+        if (!tree || tree->roots.empty())
+        {
+            return vector<pair<double, int>>();
+        }
+        vector<double> query = point.getVector();
+        vector<int> rows;
+        {
+            TraceSpan span("rp.search");
+            rows = searchForest(*tree, query.data(), k);
+        }
+        return tree->points.nearest(query.data(), rows, k);
+    }
+
+    // Falls back to the over-fetching TreeIndex::filtered_knn when the forest was built without the
+    // attributes attached now.
+    vector<pair<double, int>> filtered_knn(const DataVector &point, int k, const PointFilter &filter) const
+    {
+        shared_ptr<const RPTree> tree = snapshot.pin();
+        if (!tree || tree->roots.empty())
+        {
+            return vector<pair<double, int>>();
+        }
+        if (!tree->attributes || tree->attributes != pinAttributes())
+        {
+            return TreeIndex::filtered_knn(point, k, filter);
+        }
+        vector<double> query = point.getVector();
+        vector<int> rows;
+        {
+            TraceSpan span("rp.search");
+            rows = searchForest(*tree, query.data(), k, &filter);
+        }
+        return tree->points.nearest(query.data(), rows, k);
+    }
+
+    vector<vector<pair<double, int>>> batch_knn(const vector<DataVector> &queries, int k) const
+    {
+        vector<vector<pair<double, int>>> answers(queries.size());
+        shared_ptr<const RPTree> tree = snapshot.pin();
+        if (!tree || tree->roots.empty())
+        {
+            return answers;
+        }
+        const TreePoints &points = tree->points;
+        int dim = points.dim;
+        int budget = searchBudget;
+
+        TreePoints flat;
+        flat.load(queries);
+        vector<TopK> results(queries.size(), TopK(points.keep(k)));
+        vector<ScanJob> jobs;
+
+        // first round: every query scans its own leaf in every tree
+        {
+            TraceSpan span("batch.route");
+            for (size_t t = 0; t < tree->roots.size(); t++)
+            {
+                for (size_t q = 0; q < queries.size(); q++)
+                {
+                    const double *point = flat.row(q);
+                    const RPNode *node = tree->roots[t];
+                    while (node->left != NULL)
+                    {
+                        node = dotProduct(point, node->axis, dim) <= node->medianval ? node->left : node->right;
+                    }
+                    ScanJob job = {&tree->orders[t], node->begin, node->end, (int)q};
+                    jobs.push_back(job);
+                }
+            }
+        }
+        runScanJobs(points, flat, jobs, results);
+
+        // second round: going back up from the leaf, scan the sibling subtrees that can still hold a
+        // point closer than the current k-th best (the same rule as search(), with budget)
+        jobs.clear();
+        {
+            TraceSpan span("batch.route");
+            vector<pair<const RPNode *, double>> path; // node and projection of the query on its axis
+            for (size_t t = 0; t < tree->roots.size(); t++)
+            {
+                for (size_t q = 0; q < queries.size(); q++)
+                {
+                    const double *point = flat.row(q);
+                    path.clear();
+                    const RPNode *node = tree->roots[t];
+                    while (node->left != NULL)
+                    {
+                        double projection = dotProduct(point, node->axis, dim);
+                        path.push_back(make_pair(node, projection));
+                        node = projection <= node->medianval ? node->left : node->right;
+                    }
+
+                    double bound = results[q].worst();
+                    int collected = node->end - node->begin;
+                    for (int i = (int)path.size() - 1; i >= 0; i--)
+                    {
+                        const RPNode *parent = path[i].first;
+                        double projection = path[i].second;
+                        const RPNode *sibling = projection <= parent->medianval ? parent->right : parent->left;
+                        double mediandist = abs(parent->medianval - projection);
+                        int size = sibling->end - sibling->begin;
+                        bool affordable = budget <= 0 || collected + size <= budget;
+                        if ((bound > mediandist * mediandist && affordable) || collected < k)
+                        {
+                            ScanJob job = {&tree->orders[t], sibling->begin, sibling->end, (int)q};
+                            jobs.push_back(job);
+                            collected += size;
+                        }
+                    }
+                }
+            }
+        }
+        runScanJobs(points, flat, jobs, results);
+
+        {
+            TraceSpan span("batch.answer");
+            for (size_t q = 0; q < queries.size(); q++)
+            {
+                answers[q] = points.answer(flat.row(q), results[q].items(), k);
+            }
+        }
+        return answers;
+    }
+
+    void setParams(const IndexParams &newparams)
+    {
+        lock_guard<mutex> lock(writer);
+        params = newparams;
+        searchBudget = newparams.searchBudget;
+    }
+
+    IndexParams getParams() const
+    {
+        lock_guard<mutex> lock(writer);
+        return params;
+    }
+
+    MemoryEstimate estimateMemory(size_t points, int dim) const
+    {
+        lock_guard<mutex> lock(writer);
+        return estimate(points, dim, params);
+    }
+
+    bool maketree(const vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        return rebuild(points);
+    }
+
+    //AddData
+    bool AddData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size() + 1, newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        points.push_back(newpoint);
+        return rebuild(points);
+    }
+
+    //DeleteData
+    bool DeleteData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size(), newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        points.erase(remove(points.begin(), points.end(), newpoint), points.end());
+        return rebuild(points);
+    }
+};
+
+#endif
@@ -0,0 +1,252 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ______________________________*ResultSink* : The ResultSink class______________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    ResultSink.h contains the writer the drivers send k-NN answers to: ids and distances only, never
+    the neighbours' coordinates, in one of two formats (ResultFormat).
+
+        - RESULT_VECS: two binary files in the usual ANN benchmark layout, <path>.ivecs with the ids and
+                       <path>.fvecs with the distances; every answer is an int32 count followed by
+                       that many int32 ids / float32 distances.
+        - RESULT_CSV:  <path>.csv with a header and one "query,id,distance" line per neighbour.
+
+    Answers are formatted into a large in-memory buffer; a full buffer is handed to a background
+    thread that writes it while the caller goes on formatting the next one, so the search never waits
+    for the disk unless it outruns it by more than BUFFERS buffers.
+
+    - Member Functions:
+
+        - bool open(const string& path, int format):
+            Description:
+                Create the file(s) of format for path (without extension) and start the writer
+                thread. false if a file can not be created.
+
+        - void write(int query, const vector<pair<double, int>>& answer):
+            Description:
+                Append the answer of one query, (distance, id) pairs as knn() returns them. Answers
+                must be written by one thread at a time; they reach the files in the order written.
+
+        - bool close():
+            Description:
+                Write everything still buffered, stop the thread and close the files (the destructor
+                does too). false if any write failed.
+*/
+
+#ifndef RESULTSINK_H
+#define RESULTSINK_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "Trace.h"
+
+using namespace std;
+
+enum ResultFormat
+{
+    RESULT_NONE,
+    RESULT_VECS,
+    RESULT_CSV
+};
+
+inline int resultFormat(const string &name)
+{
+    if (name == "vecs")
+        return RESULT_VECS;
+    if (name == "csv")
+        return RESULT_CSV;
+    return RESULT_NONE;
+}
+
+inline const char *resultFormatName(int format)
+{
+    return format == RESULT_VECS ? "vecs" : format == RESULT_CSV ? "csv" : "none";
+}
+
+class ResultSink
+{
+    static const size_t BUFFERSIZE = 1 << 20;
+    static const size_t BUFFERS = 4;
+
+    // Bytes bound for one file.
+    struct Chunk
+    {
+        FILE *file;
+        vector<char> bytes;
+    };
+
+    int format;
+    FILE *ids;       // .ivecs, or the .csv
+    FILE *distances; // .fvecs
+    vector<char> idBuffer, distanceBuffer;
+
+    mutex lock;
+    condition_variable changed;
+    deque<Chunk> pending;
+    bool stopping;
+    bool failed;
+    thread writer;
+
+    void run()
+    {
+        unique_lock<mutex> guard(lock);
+        while (true)
+        {
+            changed.wait(guard, [this]() { return stopping || !pending.empty(); });
+            if (pending.empty())
+            {
+                return;
+            }
+            Chunk chunk = move(pending.front());
+            pending.pop_front();
+            guard.unlock();
+            bool ok;
+            {
+                TraceSpan span("output");
+                ok = fwrite(chunk.bytes.data(), 1, chunk.bytes.size(), chunk.file) == chunk.bytes.size();
+            }
+            guard.lock();
+            failed = failed || !ok;
+            // a slot is free again
+            changed.notify_all();
+        }
+    }
+
+    // Hand buffer to the writer thread, waiting while it is BUFFERS chunks behind.
+    void flush(FILE *file, vector<char> &buffer)
+    {
+        if (buffer.empty())
+        {
+            return;
+        }
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this]() { return pending.size() < BUFFERS; });
+        Chunk chunk;
+        chunk.file = file;
+        chunk.bytes.swap(buffer);
+        pending.push_back(move(chunk));
+        guard.unlock();
+        changed.notify_all();
+        buffer.reserve(BUFFERSIZE);
+    }
+
+    static void append(vector<char> &buffer, const void *data, size_t bytes)
+    {
+        const char *p = (const char *)data;
+        buffer.insert(buffer.end(), p, p + bytes);
+    }
+
+public:
+    ResultSink() : format(RESULT_NONE), ids(NULL), distances(NULL), stopping(false), failed(false) {}
+
+    ~ResultSink()
+    {
+        close();
+    }
+
+    bool open(const string &path, int resultFormat)
+    {
+        close();
+        format = resultFormat;
+        if (format == RESULT_VECS)
+        {
+            ids = fopen((path + ".ivecs").c_str(), "wb");
+            distances = fopen((path + ".fvecs").c_str(), "wb");
+        }
+        else if (format == RESULT_CSV)
+        {
+            ids = fopen((path + ".csv").c_str(), "wb");
+        }
+        else
+        {
+            return true;
+        }
+        if (ids == NULL || (format == RESULT_VECS && distances == NULL))
+        {
+            cerr << "Error opening file: " << path << endl;
+            close();
+            return false;
+        }
+        if (format == RESULT_CSV)
+        {
+            const char *header = "query,id,distance\n";
+            append(idBuffer, header, strlen(header));
+        }
+        idBuffer.reserve(BUFFERSIZE);
+        distanceBuffer.reserve(format == RESULT_VECS ? BUFFERSIZE : 0);
+        stopping = false;
+        failed = false;
+        writer = thread([this]() { run(); });
+        return true;
+    }
+
+    void write(int query, const vector<pair<double, int>> &answer)
+    {
+        if (format == RESULT_VECS)
+        {
+            int32_t count = answer.size();
+            append(idBuffer, &count, sizeof(count));
+            append(distanceBuffer, &count, sizeof(count));
+            for (size_t i = 0; i < answer.size(); i++)
+            {
+                int32_t id = answer[i].second;
+                float distance = answer[i].first;
+                append(idBuffer, &id, sizeof(id));
+                append(distanceBuffer, &distance, sizeof(distance));
+            }
+        }
+        else if (format == RESULT_CSV)
+        {
+            char line[64];
+            for (size_t i = 0; i < answer.size(); i++)
+            {
+                int bytes = snprintf(line, sizeof(line), "%d,%d,%.9g\n", query, answer[i].second, answer[i].first);
+                append(idBuffer, line, bytes);
+            }
+        }
+        if (idBuffer.size() >= BUFFERSIZE)
+        {
+            flush(ids, idBuffer);
+        }
+        if (distanceBuffer.size() >= BUFFERSIZE)
+        {
+            flush(distances, distanceBuffer);
+        }
+    }
+
+    bool close()
+    {
+        if (writer.joinable())
+        {
+            flush(ids, idBuffer);
+            flush(distances, distanceBuffer);
+            {
+                lock_guard<mutex> guard(lock);
+                stopping = true;
+            }
+            changed.notify_all();
+            writer.join();
+        }
+        bool ok = !failed;
+        if (ids != NULL)
+            ok = fclose(ids) == 0 && ok;
+        if (distances != NULL)
+            ok = fclose(distances) == 0 && ok;
+        ids = NULL;
+        distances = NULL;
+        idBuffer.clear();
+        distanceBuffer.clear();
+        format = RESULT_NONE;
+        return ok;
+    }
+};
+
+#endif
@@ -0,0 +1,297 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    _______________________________*Rotation* : The Rotation class_______________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    Rotation.h contains the orthonormal transforms a tree can split in instead of the original axes
+    (IndexParams::rotation). Axis-aligned splits work poorly when the variance of the data lies along
+    directions mixing many correlated features; after a rotation it lies along the new axes.
+
+        - ROTATE_PCA:      the principal axes of (a sample of) the points, largest variance first,
+                           found by a Jacobi eigendecomposition of their covariance matrix. Costs
+                           O(dim^3) once per build and dim x dims per query.
+        - ROTATE_HADAMARD: a fast structured random rotation, ROTATIONROUNDS rounds of random sign
+                           flips followed by a Walsh-Hadamard transform, over the features padded
+                           with zeros to a power of two. Learns nothing, costs O(dim log dim) per
+                           point, and spreads the variance evenly over the new axes.
+
+    The rotated coordinates only guide the traversal; distances are always computed on the original
+    vectors. Keeping only the first dims rotated coordinates (IndexParams::rotationDims) is therefore
+    safe: the distance of a point to a split plane along any unit direction is still a lower bound
+    of its distance to the query, so pruning stays exact, only less effective for the axes dropped.
+
+    - Member Functions:
+
+        - void learn(const vector<DataVector>& points, int mode, int dims):
+            Description:
+                Set up the rotation of mode for points, keeping dims coordinates (0 for all). The
+                PCA is computed on at most ROTATIONSAMPLE points spread over the dataset.
+
+        - void apply(const double* point, double* out) const:
+            Description:
+                Write the size() rotated coordinates of point to out.
+*/
+
+#ifndef ROTATION_H
+#define ROTATION_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "DataVector.h"
+#include "DistanceKernels.h"
+
+using namespace std;
+
+enum RotationMode
+{
+    ROTATE_NONE,
+    ROTATE_PCA,
+    ROTATE_HADAMARD
+};
+
+inline const char *rotationName(int mode)
+{
+    return mode == ROTATE_PCA ? "pca" : mode == ROTATE_HADAMARD ? "hadamard" : "none";
+}
+
+inline int rotationMode(const string &name)
+{
+    if (name == "pca")
+        return ROTATE_PCA;
+    if (name == "hadamard")
+        return ROTATE_HADAMARD;
+    return ROTATE_NONE;
+}
+
+// Points the PCA covariance is estimated from, and sign-flip rounds of the Hadamard rotation.
+const int ROTATIONSAMPLE = 4096;
+const int ROTATIONROUNDS = 3;
+
+class Rotation
+{
+    int mode;
+    int dim;                   // of the original points
+    int dims;                  // rotated coordinates kept
+    int padded;                // ROTATE_HADAMARD: dim rounded up to a power of two
+    vector<double> mean;       // ROTATE_PCA
+    vector<double> axes;       // ROTATE_PCA: dims x dim, one principal axis per row
+    vector<double> signs;      // ROTATE_HADAMARD: ROTATIONROUNDS x padded, +1 or -1
+
+    // In-place Walsh-Hadamard transform of n (a power of two) values, scaled to be orthonormal.
+    static void hadamard(double *x, int n)
+    {
+        for (int h = 1; h < n; h *= 2)
+        {
+            for (int i = 0; i < n; i += 2 * h)
+            {
+                for (int j = i; j < i + h; j++)
+                {
+                    double a = x[j], b = x[j + h];
+                    x[j] = a + b;
+                    x[j + h] = a - b;
+                }
+            }
+        }
+        double scale = 1 / sqrt((double)n);
+        for (int i = 0; i < n; i++)
+        {
+            x[i] *= scale;
+        }
+    }
+
+    // Eigenvectors of the symmetric n x n matrix a (destroyed) by cyclic Jacobi rotations: returns
+    // them as the columns of vectors, with the eigenvalues in values.
+    static void eigen(vector<double> &a, int n, vector<double> &vectors, vector<double> &values)
+    {
+        vectors.assign((size_t)n * n, 0);
+        for (int i = 0; i < n; i++)
+        {
+            vectors[(size_t)i * n + i] = 1;
+        }
+        for (int sweep = 0; sweep < 50; sweep++)
+        {
+            double off = 0, diagonal = 0;
+            for (int p = 0; p < n; p++)
+            {
+                diagonal += a[(size_t)p * n + p] * a[(size_t)p * n + p];
+                for (int q = p + 1; q < n; q++)
+                    off += a[(size_t)p * n + q] * a[(size_t)p * n + q];
+            }
+            if (off <= 1e-24 * diagonal || off == 0)
+            {
+                break;
+            }
+            for (int p = 0; p < n; p++)
+            {
+                for (int q = p + 1; q < n; q++)
+                {
+                    double apq = a[(size_t)p * n + q];
+                    if (apq == 0)
+                        continue;
+                    double theta = (a[(size_t)q * n + q] - a[(size_t)p * n + p]) / (2 * apq);
+                    double t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta * theta + 1));
+                    double c = 1 / sqrt(t * t + 1), s = t * c;
+                    for (int k = 0; k < n; k++)
+                    {
+                        double akp = a[(size_t)k * n + p], akq = a[(size_t)k * n + q];
+                        a[(size_t)k * n + p] = c * akp - s * akq;
+                        a[(size_t)k * n + q] = s * akp + c * akq;
+                    }
+                    for (int k = 0; k < n; k++)
+                    {
+                        double apk = a[(size_t)p * n + k], aqk = a[(size_t)q * n + k];
+                        a[(size_t)p * n + k] = c * apk - s * aqk;
+                        a[(size_t)q * n + k] = s * apk + c * aqk;
+                    }
+                    for (int k = 0; k < n; k++)
+                    {
+                        double vkp = vectors[(size_t)k * n + p], vkq = vectors[(size_t)k * n + q];
+                        vectors[(size_t)k * n + p] = c * vkp - s * vkq;
+                        vectors[(size_t)k * n + q] = s * vkp + c * vkq;
+                    }
+                }
+            }
+        }
+        values.resize(n);
+        for (int i = 0; i < n; i++)
+        {
+            values[i] = a[(size_t)i * n + i];
+        }
+    }
+
+    void learnPCA(const vector<DataVector> &points)
+    {
+        // an evenly spaced sample keeps the estimate deterministic
+        int n = points.size();
+        int count = min(n, ROTATIONSAMPLE);
+        vector<double> sample((size_t)count * dim);
+        for (int s = 0; s < count; s++)
+        {
+            vector<double> v = points[(size_t)s * n / count].getVector();
+            copy(v.begin(), v.end(), sample.begin() + (size_t)s * dim);
+        }
+
+        mean.assign(dim, 0);
+        for (int s = 0; s < count; s++)
+        {
+            for (int i = 0; i < dim; i++)
+                mean[i] += sample[(size_t)s * dim + i];
+        }
+        for (int i = 0; i < dim; i++)
+        {
+            mean[i] /= count;
+        }
+        vector<double> covariance((size_t)dim * dim, 0);
+        vector<double> centred(dim);
+        for (int s = 0; s < count; s++)
+        {
+            for (int i = 0; i < dim; i++)
+                centred[i] = sample[(size_t)s * dim + i] - mean[i];
+            for (int i = 0; i < dim; i++)
+            {
+                double ci = centred[i];
+                double *row = &covariance[(size_t)i * dim];
+                for (int j = i; j < dim; j++)
+                    row[j] += ci * centred[j];
+            }
+        }
+        for (int i = 0; i < dim; i++)
+        {
+            for (int j = 0; j < i; j++)
+                covariance[(size_t)i * dim + j] = covariance[(size_t)j * dim + i];
+        }
+
+        vector<double> vectors, values;
+        eigen(covariance, dim, vectors, values);
+        vector<int> order(dim);
+        for (int i = 0; i < dim; i++)
+        {
+            order[i] = i;
+        }
+        sort(order.begin(), order.end(), [&values](int a, int b) { return values[a] > values[b]; });
+        axes.resize((size_t)dims * dim);
+        for (int r = 0; r < dims; r++)
+        {
+            for (int i = 0; i < dim; i++)
+                axes[(size_t)r * dim + i] = vectors[(size_t)i * dim + order[r]];
+        }
+    }
+
+public:
+    Rotation() : mode(ROTATE_NONE), dim(0), dims(0), padded(0) {}
+
+    bool active() const
+    {
+        return mode != ROTATE_NONE;
+    }
+
+    int size() const
+    {
+        return dims;
+    }
+
+    void learn(const vector<DataVector> &points, int rotation, int keep)
+    {
+        mode = points.empty() ? ROTATE_NONE : rotation;
+        dim = points.empty() ? 0 : points[0].getDimension();
+        mean.clear();
+        axes.clear();
+        signs.clear();
+        if (mode == ROTATE_PCA)
+        {
+            dims = keep > 0 ? min(keep, dim) : dim;
+            learnPCA(points);
+        }
+        else if (mode == ROTATE_HADAMARD)
+        {
+            padded = 1;
+            while (padded < dim)
+                padded *= 2;
+            dims = keep > 0 ? min(keep, padded) : padded;
+            mt19937 gen(5489u);
+            signs.resize((size_t)ROTATIONROUNDS * padded);
+            for (size_t i = 0; i < signs.size(); i++)
+            {
+                signs[i] = gen() & 1 ? 1 : -1;
+            }
+        }
+        else
+        {
+            dims = dim;
+        }
+    }
+
+    void apply(const double *point, double *out) const
+    {
+        if (mode == ROTATE_PCA)
+        {
+            vector<double> centred(dim);
+            for (int i = 0; i < dim; i++)
+                centred[i] = point[i] - mean[i];
+            for (int r = 0; r < dims; r++)
+                out[r] = dotProduct(&axes[(size_t)r * dim], centred.data(), dim);
+        }
+        else if (mode == ROTATE_HADAMARD)
+        {
+            vector<double> x(padded, 0);
+            copy(point, point + dim, x.begin());
+            for (int round = 0; round < ROTATIONROUNDS; round++)
+            {
+                const double *flip = &signs[(size_t)round * padded];
+                for (int i = 0; i < padded; i++)
+                    x[i] *= flip[i];
+                hadamard(x.data(), padded);
+            }
+            copy(x.begin(), x.begin() + dims, out);
+        }
+        else
+        {
+            copy(point, point + dim, out);
+        }
+    }
+};
+
+#endif
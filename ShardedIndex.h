@@ -0,0 +1,546 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ________________________*ShardedIndex* : The ShardedIndex class________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    ShardedIndex.h contains ShardedIndex<Engine>, a TreeIndex that splits the points over
+    IndexParams::shards independent Engine indexes (KDTreeIndex, RPTreeIndex, HNSWIndex, ...).
+
+    - Partition (IndexParams::shardRule):
+        - SHARD_RANDOM:  every point goes to a random shard; a query asks every shard.
+        - SHARD_CLUSTER: k-means on a sample of the points gives one centroid per shard and every
+                         point goes to the shard of its nearest centroid; a query asks only the
+                         IndexParams::shardProbe shards with the nearest centroids (0 for all).
+    - The shards are built in parallel, one per thread (IndexParams::threads).
+    - A query fans out to its shards in parallel, each shard returns its own k best and the lists
+      are merged. batch_knn sends every shard one batch with the queries that probe it.
+    - setAttributes gives every shard the attributes of its own points, by local id, so
+      filtered_knn fans out to the shards like knn and every shard filters during its own search.
+    - AddData / DeleteData rebuild only the shards that hold the point; the other shards keep
+      their trees and only have their ids renumbered.
+
+    Ids are positions in the points given to maketree, as for any TreeIndex. Every shard knows the
+    global id of each of its points.
+
+    The shards and their id maps are published together as one immutable ShardSet through a
+    Snapshot (see TreeIndex.h): an update builds the changed shards off to the side and swaps the
+    whole set at once, so a query never mixes a new shard with an old id map.
+
+    - Functions:
+
+        - TreeIndex* makeIndex<Engine>(const IndexParams& params):
+            Description:
+                A new Engine, or a ShardedIndex<Engine> of params.shards of them if params.shards
+                is more than 1. The caller owns it.
+*/
+
+#ifndef SHARDEDINDEX_H
+#define SHARDEDINDEX_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include "DataVector.h"
+#include "TreeIndex.h"
+#include "DistanceKernels.h"
+#include "PointAttributes.h"
+
+using namespace std;
+
+// One published version of the shards.
+template <class Engine>
+struct ShardSet
+{
+    vector<shared_ptr<Engine>> engines;
+    vector<vector<int>> ids;   // ids[s][i]: global id of point i of shard s
+    vector<double> centroids;  // SHARD_CLUSTER: shards x dim
+    int dim;
+
+    ShardSet() : dim(0) {}
+};
+
+template <class Engine>
+class ShardedIndex : public TreeIndex
+{
+    Snapshot<ShardSet<Engine>> snapshot;
+    mutable mutex writer;
+    IndexParams params;
+    atomic<int> shardProbe;             // IndexParams::shardProbe and threads, read by queries
+    atomic<int> threads;                // without the writer lock
+    vector<vector<DataVector>> members; // points of every shard, for rebuilding it
+
+    // Build the shard s of set over members[s], with the attributes of its points.
+    void buildShard(ShardSet<Engine> &set, int s) const
+    {
+        IndexParams shardParams = params;
+        // the shards already run in parallel, and were admitted to the memory budget together
+        shardParams.threads = 1;
+        shardParams.memoryBudget = 0;
+        set.engines[s] = make_shared<Engine>(shardParams);
+        shared_ptr<const PointAttributes> attributes = pinAttributes();
+        if (attributes)
+        {
+            set.engines[s]->setAttributes(localAttributes(set, s, *attributes));
+        }
+        set.engines[s]->maketree(members[s]);
+    }
+
+    // The attributes of the points of shard s, by local id. ids[s] is increasing, so the points
+    // attributes does not cover yet are the last ones; they are left out and match no filter.
+    static shared_ptr<const PointAttributes> localAttributes(const ShardSet<Engine> &set, int s,
+                                                             const PointAttributes &attributes)
+    {
+        shared_ptr<PointAttributes> local = make_shared<PointAttributes>();
+        const vector<int> &ids = set.ids[s];
+        for (size_t i = 0; i < ids.size() && ids[i] < attributes.size(); i++)
+        {
+            local->add(attributes.labelsOf(ids[i]), attributes.tenantOf(ids[i]));
+        }
+        return local;
+    }
+
+    // Squared distance of point to the centroid of shard s.
+    static double centroidDistance(const ShardSet<Engine> &set, const double *point, int s)
+    {
+        return squaredDistance(point, &set.centroids[(size_t)s * set.dim], set.dim);
+    }
+
+    // The shards a query asks, nearest centroid first for SHARD_CLUSTER: the probes nearest, or all
+    // of them if probes is 0.
+    vector<int> probe(const ShardSet<Engine> &set, const double *point, int probes) const
+    {
+        int count = set.engines.size();
+        vector<int> shards(count);
+        for (int s = 0; s < count; s++)
+        {
+            shards[s] = s;
+        }
+        if (set.centroids.empty() || probes <= 0 || probes >= count)
+        {
+            return shards;
+        }
+        vector<pair<double, int>> order(count);
+        for (int s = 0; s < count; s++)
+        {
+            order[s] = make_pair(centroidDistance(set, point, s), s);
+        }
+        partial_sort(order.begin(), order.begin() + probes, order.end());
+        shards.resize(probes);
+        for (int i = 0; i < probes; i++)
+        {
+            shards[i] = order[i].second;
+        }
+        return shards;
+    }
+
+    // Shard of a new point: nearest centroid, or the smallest shard for SHARD_RANDOM.
+    int shardFor(const ShardSet<Engine> &set, const DataVector &point) const
+    {
+        if (!set.centroids.empty())
+        {
+            vector<double> v = point.getVector();
+            return nearestCentroid(set, v.data());
+        }
+        int best = 0;
+        for (size_t s = 1; s < members.size(); s++)
+        {
+            if (members[s].size() < members[best].size())
+                best = s;
+        }
+        return best;
+    }
+
+    static int nearestCentroid(const ShardSet<Engine> &set, const double *point)
+    {
+        int best = 0, count = set.centroids.size() / max(1, set.dim);
+        for (int s = 1; s < count; s++)
+        {
+            if (centroidDistance(set, point, s) < centroidDistance(set, point, best))
+                best = s;
+        }
+        return best;
+    }
+
+    // Lloyd's k-means on a sample of at most 256 points per shard, seeded with distinct sample points.
+    static vector<double> trainCentroids(const vector<DataVector> &points, int shards, int dim)
+    {
+        const int ITERATIONS = 10;
+        mt19937 gen(5489u);
+        vector<int> sample(points.size());
+        for (size_t i = 0; i < sample.size(); i++)
+        {
+            sample[i] = i;
+        }
+        shuffle(sample.begin(), sample.end(), gen);
+        sample.resize(min(sample.size(), (size_t)256 * shards));
+
+        TreePoints rows;
+        vector<DataVector> picked;
+        for (size_t i = 0; i < sample.size(); i++)
+        {
+            picked.push_back(points[sample[i]]);
+        }
+        rows.load(picked);
+
+        ShardSet<Engine> set;
+        set.dim = dim;
+        set.centroids.assign((size_t)shards * dim, 0);
+        for (int s = 0; s < shards; s++)
+        {
+            copy(rows.row(s % rows.size()), rows.row(s % rows.size()) + dim, &set.centroids[(size_t)s * dim]);
+        }
+        vector<double> sums;
+        vector<int> counts;
+        for (int it = 0; it < ITERATIONS; it++)
+        {
+            sums.assign((size_t)shards * dim, 0);
+            counts.assign(shards, 0);
+            for (int i = 0; i < rows.size(); i++)
+            {
+                int s = nearestCentroid(set, rows.row(i));
+                for (int d = 0; d < dim; d++)
+                    sums[(size_t)s * dim + d] += rows.row(i)[d];
+                counts[s]++;
+            }
+            for (int s = 0; s < shards; s++)
+            {
+                // an empty cluster keeps its centroid
+                for (int d = 0; d < dim && counts[s] > 0; d++)
+                    set.centroids[(size_t)s * dim + d] = sums[(size_t)s * dim + d] / counts[s];
+            }
+        }
+        return set.centroids;
+    }
+
+    // Upper bound of the memory of a build over n points of dimension dim (see TreeIndex::estimateMemory):
+    // the copies of the points kept per shard, and the shards.
+    static MemoryEstimate estimate(size_t n, int dim, const IndexParams &params)
+    {
+        size_t shards = max(1, params.shards);
+        IndexParams shardParams = params;
+        shardParams.threads = 1;
+        MemoryEstimate memory = Engine(shardParams).estimateMemory((n + shards - 1) / shards, dim).times(shards);
+        memory.dataset += n * (sizeof(DataVector) + dim * sizeof(double));
+        memory.ids += n * sizeof(int);
+        return memory;
+    }
+
+    // Partition points over the shards and build every shard, unless they do not fit in the memory
+    // budget together, in which case it returns false.
+    bool rebuild(const vector<DataVector> &points)
+    {
+        if (!admitBuild(estimate(points.size(), points.empty() ? 0 : points[0].getDimension(), params), params))
+        {
+            return false;
+        }
+        shared_ptr<ShardSet<Engine>> set = make_shared<ShardSet<Engine>>();
+        int shards = max(1, params.shards);
+        set->dim = points.empty() ? 0 : points[0].getDimension();
+        set->engines.resize(shards);
+        set->ids.assign(shards, vector<int>());
+        members.assign(shards, vector<DataVector>());
+
+        if (params.shardRule == SHARD_CLUSTER && !points.empty())
+        {
+            set->centroids = trainCentroids(points, shards, set->dim);
+        }
+        mt19937 gen(5489u);
+        uniform_int_distribution<int> pick(0, shards - 1);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            int s;
+            if (set->centroids.empty())
+            {
+                s = pick(gen);
+            }
+            else
+            {
+                vector<double> v = points[i].getVector();
+                s = nearestCentroid(*set, v.data());
+            }
+            members[s].push_back(points[i]);
+            set->ids[s].push_back(i);
+        }
+
+        parallelFor(shards, params.threads, [&](int s, int) { buildShard(*set, s); });
+        snapshot.publish(set);
+        return true;
+    }
+
+    // Merge per-shard answers (local ids) into the k nearest (distance, global id) pairs.
+    static vector<pair<double, int>> merge(const ShardSet<Engine> &set, const vector<int> &shards,
+                                           const vector<vector<pair<double, int>>> &answers, int k)
+    {
+        vector<pair<double, int>> merged;
+        for (size_t i = 0; i < shards.size(); i++)
+        {
+            const vector<int> &ids = set.ids[shards[i]];
+            for (size_t j = 0; j < answers[i].size(); j++)
+            {
+                merged.push_back(make_pair(answers[i][j].first, ids[answers[i][j].second]));
+            }
+        }
+        k = min(k, (int)merged.size());
+        partial_sort(merged.begin(), merged.begin() + k, merged.end());
+        merged.resize(k);
+        return merged;
+    }
+
+public:
+    ShardedIndex(const IndexParams &params = IndexParams())
+        : params(params), shardProbe(params.shardProbe), threads(params.threads) {}
+
+    vector<DataVector> query_search(const DataVector &point, int k) const
+    {
+        shared_ptr<const ShardSet<Engine>> set = snapshot.pin();
+        vector<DataVector> candidates;
+        if (!set)
+        {
+            return candidates;
+        }
+        vector<double> query = point.getVector();
+        vector<int> shards = probe(*set, query.data(), shardProbe);
+        vector<vector<DataVector>> found(shards.size());
+        parallelFor(shards.size(), threads, [&](int i, int) {
+            found[i] = set->engines[shards[i]]->query_search(point, k);
+        });
+        for (size_t i = 0; i < found.size(); i++)
+        {
+            candidates.insert(candidates.end(), found[i].begin(), found[i].end());
+        }
+        return candidates;
+    }
+
+    vector<pair<double, int>> knn(const DataVector &point, int k) const
+    {
+        shared_ptr<const ShardSet<Engine>> set = snapshot.pin();
+        if (!set)
+        {
+            return vector<pair<double, int>>();
+        }
+        vector<double> query = point.getVector();
+        vector<int> shards = probe(*set, query.data(), shardProbe);
+        vector<vector<pair<double, int>>> answers(shards.size());
+        parallelFor(shards.size(), threads, [&](int i, int) {
+            answers[i] = set->engines[shards[i]]->knn(point, k);
+        });
+        return merge(*set, shards, answers, k);
+    }
+
+    vector<vector<pair<double, int>>> batch_knn(const vector<DataVector> &queries, int k) const
+    {
+        vector<vector<pair<double, int>>> answers(queries.size());
+        shared_ptr<const ShardSet<Engine>> set = snapshot.pin();
+        if (!set)
+        {
+            return answers;
+        }
+        int count = set->engines.size();
+        int probes = shardProbe;
+
+        // which queries every shard answers
+        vector<vector<int>> probed(queries.size());
+        vector<vector<int>> asked(count);
+        for (size_t q = 0; q < queries.size(); q++)
+        {
+            vector<double> query = queries[q].getVector();
+            probed[q] = probe(*set, query.data(), probes);
+            for (size_t i = 0; i < probed[q].size(); i++)
+            {
+                asked[probed[q][i]].push_back(q);
+            }
+        }
+
+        // one batch per shard; partial[s][j] answers query asked[s][j]
+        vector<vector<vector<pair<double, int>>>> partial(count);
+        parallelFor(count, threads, [&](int s, int) {
+            vector<DataVector> batch;
+            for (size_t j = 0; j < asked[s].size(); j++)
+            {
+                batch.push_back(queries[asked[s][j]]);
+            }
+            partial[s] = set->engines[s]->batch_knn(batch, k);
+        });
+
+        vector<size_t> next(count, 0);
+        for (size_t q = 0; q < queries.size(); q++)
+        {
+            vector<vector<pair<double, int>>> mine;
+            for (size_t i = 0; i < probed[q].size(); i++)
+            {
+                int s = probed[q][i];
+                mine.push_back(partial[s][next[s]++]);
+            }
+            answers[q] = merge(*set, probed[q], mine, k);
+        }
+        return answers;
+    }
+
+    vector<pair<double, int>> filtered_knn(const DataVector &point, int k, const PointFilter &filter) const
+    {
+        shared_ptr<const ShardSet<Engine>> set = snapshot.pin();
+        if (!set || !pinAttributes())
+        {
+            return vector<pair<double, int>>();
+        }
+        vector<double> query = point.getVector();
+        vector<int> shards = probe(*set, query.data(), shardProbe);
+        vector<vector<pair<double, int>>> answers(shards.size());
+        parallelFor(shards.size(), threads, [&](int i, int) {
+            answers[i] = set->engines[shards[i]]->filtered_knn(point, k, filter);
+        });
+        return merge(*set, shards, answers, k);
+    }
+
+    // Every shard of the current set gets its part at once; the shards built later take theirs in
+    // buildShard.
+    void setAttributes(shared_ptr<const PointAttributes> attributes)
+    {
+        lock_guard<mutex> lock(writer);
+        TreeIndex::setAttributes(attributes);
+        shared_ptr<const ShardSet<Engine>> set = snapshot.pin();
+        if (set)
+        {
+            for (size_t s = 0; s < set->engines.size(); s++)
+            {
+                set->engines[s]->setAttributes(attributes ? localAttributes(*set, s, *attributes) : attributes);
+            }
+        }
+    }
+
+    // Build parameters (shards, shardRule) apply at the next maketree; the rest is passed on to the
+    // shards, which apply their search parameters at once.
+    void setParams(const IndexParams &newparams)
+    {
+        lock_guard<mutex> lock(writer);
+        params = newparams;
+        shardProbe = newparams.shardProbe;
+        threads = newparams.threads;
+        shared_ptr<const ShardSet<Engine>> set = snapshot.pin();
+        if (set)
+        {
+            IndexParams shardParams = newparams;
+            shardParams.threads = 1;
+            shardParams.memoryBudget = 0;
+            for (size_t s = 0; s < set->engines.size(); s++)
+            {
+                set->engines[s]->setParams(shardParams);
+            }
+        }
+    }
+
+    IndexParams getParams() const
+    {
+        lock_guard<mutex> lock(writer);
+        return params;
+    }
+
+    MemoryEstimate estimateMemory(size_t points, int dim) const
+    {
+        lock_guard<mutex> lock(writer);
+        return estimate(points, dim, params);
+    }
+
+    bool maketree(const vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        return rebuild(points);
+    }
+
+    //AddData
+    bool AddData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size() + 1, newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        shared_ptr<const ShardSet<Engine>> current = snapshot.pin();
+        if (!current || current->engines.empty())
+        {
+            points.push_back(newpoint);
+            return rebuild(points);
+        }
+
+        shared_ptr<ShardSet<Engine>> set = make_shared<ShardSet<Engine>>(*current);
+        int s = shardFor(*set, newpoint);
+        members[s].push_back(newpoint);
+        set->ids[s].push_back(points.size());
+        points.push_back(newpoint);
+        buildShard(*set, s);
+        snapshot.publish(set);
+        return true;
+    }
+
+    //DeleteData
+    bool DeleteData(DataVector &newpoint, vector<DataVector> &points)
+    {
+        lock_guard<mutex> lock(writer);
+        if (!admitBuild(estimate(points.size(), newpoint.getDimension(), params), params))
+        {
+            return false;
+        }
+        shared_ptr<const ShardSet<Engine>> current = snapshot.pin();
+        if (!current || current->engines.empty())
+        {
+            points.erase(remove(points.begin(), points.end(), newpoint), points.end());
+            return rebuild(points);
+        }
+
+        // removed[i]: number of deleted points before global id i, -1 if i itself is deleted
+        vector<int> removed(points.size());
+        int count = 0;
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            bool deleted = points[i] == newpoint;
+            removed[i] = deleted ? -1 : count;
+            count += deleted;
+        }
+        if (count == 0)
+        {
+            return true;
+        }
+        points.erase(remove(points.begin(), points.end(), newpoint), points.end());
+
+        shared_ptr<ShardSet<Engine>> set = make_shared<ShardSet<Engine>>(*current);
+        vector<int> changed;
+        for (size_t s = 0; s < set->ids.size(); s++)
+        {
+            vector<int> &ids = set->ids[s];
+            size_t kept = 0;
+            for (size_t i = 0; i < ids.size(); i++)
+            {
+                if (removed[ids[i]] < 0)
+                    continue;
+                members[s][kept] = members[s][i];
+                ids[kept++] = ids[i] - removed[ids[i]];
+            }
+            if (kept < ids.size())
+            {
+                ids.resize(kept);
+                members[s].resize(kept);
+                changed.push_back(s);
+            }
+        }
+        parallelFor(changed.size(), params.threads, [&](int i, int) { buildShard(*set, changed[i]); });
+        snapshot.publish(set);
+        return true;
+    }
+};
+
+// An Engine, or a ShardedIndex of params.shards of them.
+template <class Engine>
+TreeIndex *makeIndex(const IndexParams &params)
+{
+    if (params.shards > 1)
+        return new ShardedIndex<Engine>(params);
+    return new Engine(params);
+}
+
+#endif
@@ -0,0 +1,205 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    _______________________________*Trace* : Phase-level tracing_______________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    Trace.h contains scoped tracing spans for the phases of loading, building and querying, written
+    out in the Chrome trace-event format (a JSON file that opens in Perfetto or chrome://tracing).
+
+    Tracing is off until startTracing() is called; every driver calls traceFromEnvironment(), which
+    starts it when the environment variable NN_TRACE names an output file and writes that file when
+    the program exits:
+
+        NN_TRACE=trace.json ./kdtree
+
+    While tracing is off a span costs one relaxed atomic load. While it is on, a span records its
+    name, start and duration into a buffer of its own thread, with no lock; the buffers are only
+    gathered when the trace is written.
+
+    Spans: load.csv, load.parse (one block parsed by CSVStream, Pipeline.h), load.binary,
+    save.binary, <engine>.build and its phases (kd.chooseRule and kd.partition for nodes of at least
+    TRACE_MINNODE points, <engine>.finish for the storage encoding, hnsw.link), <engine>.search
+    (traversal), scan (leaf scans of one query), rerank, batch.route / batch.scan / batch.answer
+    (batch_knn), join.build / join.traverse (DualTreeJoin.h),
+    knearestneighbor (the exact pass over query_search candidates) and output in the drivers.
+
+    - Classes:
+
+        - TraceSpan(const char* name):
+            Description:
+                Records the time from its construction to its destruction under name, which must
+                be a string literal (only the pointer is kept).
+
+    - Functions:
+
+        - bool startTracing(const string& filename):
+            Description:
+                Drop any recorded spans and start recording; stopTracing() will write filename.
+
+        - bool stopTracing():
+            Description:
+                Stop recording and write the trace. Call it once no span is open any more (the
+                drivers do at exit). false if the trace could not be written.
+
+        - void traceFromEnvironment():
+            Description:
+                startTracing($NN_TRACE) if it is set, with stopTracing() at exit.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+// Smallest KD-tree node whose build phases get spans of their own; smaller nodes would only bloat
+// the trace.
+const int TRACE_MINNODE = 4096;
+
+struct TraceEvent
+{
+    const char *name;
+    double start;    // microseconds since startTracing()
+    double duration; // microseconds
+};
+
+struct TraceBuffer
+{
+    int thread;
+    vector<TraceEvent> events;
+};
+
+struct TraceState
+{
+    atomic<bool> enabled;
+    atomic<int> generation; // bumped by every startTracing(), so threads drop stale buffers
+    chrono::steady_clock::time_point origin;
+    string filename;
+    mutex lock;
+    vector<shared_ptr<TraceBuffer>> buffers;
+
+    TraceState() : enabled(false), generation(0) {}
+};
+
+inline TraceState &traceState()
+{
+    static TraceState state;
+    return state;
+}
+
+// The buffer of the calling thread for the current trace.
+inline TraceBuffer &traceBuffer()
+{
+    thread_local TraceBuffer *buffer = NULL;
+    thread_local int generation = -1;
+    TraceState &state = traceState();
+    if (buffer == NULL || generation != state.generation.load())
+    {
+        lock_guard<mutex> guard(state.lock);
+        shared_ptr<TraceBuffer> fresh = make_shared<TraceBuffer>();
+        fresh->thread = state.buffers.size() + 1;
+        state.buffers.push_back(fresh);
+        buffer = fresh.get();
+        generation = state.generation.load();
+    }
+    return *buffer;
+}
+
+class TraceSpan
+{
+    const char *name;
+    chrono::steady_clock::time_point start;
+
+public:
+    explicit TraceSpan(const char *spanName) : name(NULL)
+    {
+        if (traceState().enabled.load(memory_order_relaxed))
+        {
+            name = spanName;
+            start = chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (name == NULL)
+        {
+            return;
+        }
+        TraceState &state = traceState();
+        chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+        TraceEvent event = {name, chrono::duration<double, micro>(start - state.origin).count(),
+                            chrono::duration<double, micro>(stop - start).count()};
+        traceBuffer().events.push_back(event);
+    }
+
+private:
+    TraceSpan(const TraceSpan &);
+    TraceSpan &operator=(const TraceSpan &);
+};
+
+inline bool startTracing(const string &filename)
+{
+    TraceState &state = traceState();
+    {
+        lock_guard<mutex> guard(state.lock);
+        state.buffers.clear();
+        state.filename = filename;
+        state.origin = chrono::steady_clock::now();
+        state.generation++;
+    }
+    state.enabled = true;
+    return true;
+}
+
+inline bool stopTracing()
+{
+    TraceState &state = traceState();
+    if (!state.enabled.exchange(false))
+    {
+        return true;
+    }
+    lock_guard<mutex> guard(state.lock);
+    ofstream file(state.filename);
+    if (!file.is_open())
+    {
+        cerr << "Error opening file: " << state.filename << endl;
+        return false;
+    }
+    file << "{\"traceEvents\":[";
+    bool first = true;
+    for (size_t b = 0; b < state.buffers.size(); b++)
+    {
+        const TraceBuffer &buffer = *state.buffers[b];
+        for (size_t e = 0; e < buffer.events.size(); e++)
+        {
+            const TraceEvent &event = buffer.events[e];
+            file << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                 << buffer.thread << ",\"ts\":" << fixed << event.start << ",\"dur\":" << event.duration << "}";
+            first = false;
+        }
+    }
+    file << "\n]}\n";
+    return true;
+}
+
+inline void traceFromEnvironment()
+{
+    const char *filename = getenv("NN_TRACE");
+    if (filename != NULL && *filename != '\0')
+    {
+        startTracing(filename);
+        atexit([]() { stopTracing(); });
+    }
+}
+
+#endif
@@ -1,17 +1,781 @@
-#include <vector>
-#include <iostream>
-#include <algorithm>
-#include <cmath>
-#include "DataVector.h"
-
-using namespace std;
-
-class TreeIndex
-{
-protected:
-    TreeIndex() {}
-    ~TreeIndex() {}
-
-public:
-    static TreeIndex &GetInstance();
-};
\ No newline at end of file
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ______________________________*TreeIndex* : The TreeIndex interface______________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    TreeIndex.h declares the interface shared by every index (KDTreeIndex, RPTreeIndex, HNSWIndex, ...).
+
+    Indexes are ordinary objects: any number of them can exist at once, each owning its own tree.
+
+    Concurrency model:
+        - A built tree is immutable. Each index publishes its current tree through an atomic
+          shared pointer (the "snapshot").
+        - Readers (query_search, knn, ...) pin the current snapshot with one atomic load and search it
+          without holding any lock of the index, so a reader never waits for a build. The atomic
+          load and store of a shared_ptr are not lock-free in libstdc++: they take a short internal
+          lock around the copy of the pointer, so a pin can wait for another pin or for a publish,
+          never for more than that.
+        - Writers (maketree, AddData, DeleteData) are serialized among themselves, build the new tree
+          off to the side and publish it with one atomic store.
+        - An old tree is reclaimed when the last reader holding it drops its pin.
+
+    - Member Functions:
+
+        - bool maketree(const vector<DataVector>& points):
+            Description:
+                Build a new tree over points and publish it. false, keeping the current tree, when
+                the build does not fit in IndexParams::memoryBudget (see estimateMemory).
+
+        - vector<DataVector> query_search(const DataVector& point, int k) const:
+            Description:
+                Return the candidate set for the k nearest neighbours of point. Safe to call from
+                any number of threads, also while an update is in progress.
+
+        - vector<pair<double, int>> knn(const DataVector& point, int k) const:
+            Description:
+                Return the k nearest candidates of point as (distance, id) pairs sorted by distance,
+                where id is the position of the neighbour in the points the tree was built from.
+
+        - vector<vector<pair<double, int>>> batch_knn(const vector<DataVector>& queries, int k) const:
+            Description:
+                knn() for a whole batch of queries. Routes all queries through the tree first, then
+                scans every leaf once for all the queries that reach it with blocked distance products
+                (see BatchQuery.h), which keeps the leaf in cache across queries.
+
+        - void setParams(const IndexParams& params):
+            Description:
+                Replace the parameters of the index. The search budget applies to the next query,
+                the build parameters to the next build.
+
+        - bool AddData(DataVector& newpoint, vector<DataVector>& points):
+        - bool DeleteData(DataVector& newpoint, vector<DataVector>& points):
+            Description:
+                Add newpoint to / remove newpoint from points and publish a tree over the result.
+                The memory budget is checked first: when the build does not fit, points and the
+                current tree are left as they are and the call returns false, so the ids of the
+                tree always name the points of the caller's vector.
+
+        - MemoryEstimate estimateMemory(size_t points, int dim) const:
+            Description:
+                Upper bound of the memory a build over points points of dimension dim takes with the
+                current parameters, by component (see MemoryBudget.h). Every build checks it against
+                IndexParams::memoryBudget first and is refused, keeping the current tree and
+                returning false, when it does not fit; drivers check it before they build, to stop
+                with an error instead.
+
+        - void setAttributes(shared_ptr<const PointAttributes> attributes):
+            Description:
+                Attach the labels and tenants of the points (see PointAttributes.h), attributes of id
+                i for the point of id i. Indexes that summarize them in their nodes do so at the next
+                build. Replace them (and rebuild) when the points change.
+
+        - vector<pair<double, int>> filtered_knn(const DataVector& point, int k, const PointFilter& filter) const:
+            Description:
+                knn() among the points that match filter only. By default the index over-fetches
+                with knn() and drops the points that do not match, asking for 4 times more until k
+                match; the trees, HNSWIndex and BruteForceIndex apply the filter during their search
+                instead, and ShardedIndex passes it on to its shards.
+*/
+
+#ifndef TREEINDEX_H
+#define TREEINDEX_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include "DataVector.h"
+#include "DistanceKernels.h"
+#include "VectorStore.h"
+#include "HugePages.h"
+#include "MemoryBudget.h"
+#include "PointAttributes.h"
+#include "Trace.h"
+#include "ResultSink.h"
+#include "Rotation.h"
+
+using namespace std;
+
+// Default largest number of points stored in a leaf; set it at build time with -DTREE_MINSIZE=<n>
+// or per index through IndexParams::leafSize.
+#ifndef TREE_MINSIZE
+#define TREE_MINSIZE 2
+#endif
+const int MINSIZE = TREE_MINSIZE;
+
+// How a KD-tree node picks its split (IndexParams::splitRule):
+//  - SPLIT_VARIANCE: feature with the largest variance, split at the median;
+//  - SPLIT_SPREAD:   feature with the largest spread (max - min), split at the median;
+//  - SPLIT_MIDPOINT: feature with the largest spread, split at the middle of the spread (sliding
+//                    midpoint: the split slides to the nearest point if one side would be empty).
+enum SplitRule
+{
+    SPLIT_VARIANCE,
+    SPLIT_SPREAD,
+    SPLIT_MIDPOINT
+};
+
+// How ShardedIndex spreads the points over its shards (IndexParams::shardRule):
+//  - SHARD_RANDOM:  uniformly at random, every query asks every shard;
+//  - SHARD_CLUSTER: to the nearest of one k-means centroid per shard, a query asks the shardProbe
+//                   shards with the nearest centroids.
+enum ShardRule
+{
+    SHARD_RANDOM,
+    SHARD_CLUSTER
+};
+
+// Index a driver builds (IndexParams::engine). ENGINE_AUTO lets the driver pick one from the data
+// (see EngineSelector.h).
+enum Engine
+{
+    ENGINE_AUTO,
+    ENGINE_KD,
+    ENGINE_RP,
+    ENGINE_BALL,
+    ENGINE_HNSW,
+    ENGINE_BRUTEFORCE
+};
+
+inline const char *engineName(int engine)
+{
+    switch (engine)
+    {
+    case ENGINE_KD:
+        return "kd";
+    case ENGINE_RP:
+        return "rp";
+    case ENGINE_BALL:
+        return "ball";
+    case ENGINE_HNSW:
+        return "hnsw";
+    case ENGINE_BRUTEFORCE:
+        return "bf";
+    default:
+        return "auto";
+    }
+}
+
+// The Engine of a name, -1 if there is none.
+inline int engineKind(const string &name)
+{
+    for (int engine = ENGINE_AUTO; engine <= ENGINE_BRUTEFORCE; engine++)
+    {
+        if (name == engineName(engine))
+            return engine;
+    }
+    return -1;
+}
+
+// Build and search parameters of an index. save() writes them as "name=value" lines and load() reads
+// such a file back, so a configuration picked by the autotuner can be reused by every driver.
+struct IndexParams
+{
+    int leafSize;     // largest number of points in a leaf
+    int numTrees;     // number of independent trees searched per query (RPTreeIndex)
+    int searchBudget; // most candidates a query collects from one tree, 0 for no limit
+    int splitRule;    // SplitRule of KDTreeIndex
+    int splitSample;  // KDTreeIndex estimates split statistics from this many random points, 0 for all
+    int storage;      // StorageMode of the scanned rows
+    int rerank;       // lossy storage: re-score the best rerank * k candidates exactly, 0 to not
+    int pqSubspaces;  // STORE_PQ: subspaces (bytes per row), 0 for dim / 4
+    int M;              // HNSWIndex: links per node on the upper layers (2 * M on the bottom layer)
+    int efConstruction; // HNSWIndex: candidates kept while linking a new node
+    int efSearch;       // HNSWIndex: candidates kept by a query (at least k)
+    int threads;        // worker threads of builds and batches, 0 for one per hardware thread
+    int cacheSize;      // CachedIndex: answers kept, 0 for no cache
+    double cacheStep;   // CachedIndex: queries are keyed on a grid of this step, 0 for exact keys
+    int batchSize;      // server: most requests answered by one batch_knn
+    int batchWait;      // server: microseconds a batch waits to fill up after its first request
+    int shards;         // ShardedIndex: number of shards, 1 for an unsharded index
+    int shardRule;      // ShardRule of ShardedIndex
+    int shardProbe;     // ShardedIndex, SHARD_CLUSTER: shards asked per query, 0 for all
+    int varianceOrder;  // 1: early-abandoned scans sum the high-variance features first
+    int resultFormat;   // drivers: ResultFormat the answers of the batch are written in
+    int printVectors;   // drivers: 1 to print the coordinates of every neighbour found to cout
+    int rotation;       // KDTreeIndex: RotationMode of the coordinates the tree splits on
+    int rotationDims;   // KDTreeIndex: rotated coordinates the tree splits on, 0 for all
+    int engine;         // drivers that can build any index: the Engine to build
+    int leafBlocks;     // KDTreeIndex, RPTreeIndex: 1 to lay float64 / float32 leaves out in dimension-major blocks
+    int hugePages;      // HugePageMode of the rows and nodes of the builds
+    int memoryBudget;   // MB a build may take (see estimateMemory), 0 for no limit
+    int deltaSize;      // DeltaIndex: appended points that start a fold into a new tree, 0 for no delta
+
+    IndexParams()
+        : leafSize(MINSIZE), numTrees(1), searchBudget(0), splitRule(SPLIT_VARIANCE), splitSample(0),
+          storage(STORE_FLOAT64), rerank(0), pqSubspaces(0), M(16), efConstruction(200), efSearch(64), threads(0),
+          cacheSize(0), cacheStep(0), batchSize(64), batchWait(200), shards(1),
+          shardRule(SHARD_RANDOM), shardProbe(0), varianceOrder(0),
+          resultFormat(RESULT_NONE), printVectors(0), rotation(ROTATE_NONE), rotationDims(0), engine(ENGINE_AUTO),
+          leafBlocks(0), hugePages(HUGEPAGES_NONE), memoryBudget(0), deltaSize(0) {}
+
+    bool load(const string &filename)
+    {
+        ifstream file(filename);
+        if (!file.is_open())
+        {
+            cerr << "Error opening file: " << filename << endl;
+            return false;
+        }
+
+        string line;
+        while (getline(file, line))
+        {
+            size_t eq = line.find('=');
+            if (eq == string::npos || line[0] == '#')
+            {
+                continue;
+            }
+            string name = line.substr(0, eq);
+            string text = line.substr(eq + 1);
+            int value = atoi(text.c_str());
+            if (name == "leafSize")
+                leafSize = value;
+            else if (name == "numTrees")
+                numTrees = value;
+            else if (name == "searchBudget")
+                searchBudget = value;
+            else if (name == "splitRule")
+                splitRule = text == "spread" ? SPLIT_SPREAD : text == "midpoint" ? SPLIT_MIDPOINT : SPLIT_VARIANCE;
+            else if (name == "splitSample")
+                splitSample = value;
+            else if (name == "storage")
+                storage = storageMode(text);
+            else if (name == "rerank")
+                rerank = value;
+            else if (name == "pqSubspaces")
+                pqSubspaces = value;
+            else if (name == "M")
+                M = value;
+            else if (name == "efConstruction")
+                efConstruction = value;
+            else if (name == "efSearch")
+                efSearch = value;
+            else if (name == "threads")
+                threads = value;
+            else if (name == "cacheSize")
+                cacheSize = value;
+            else if (name == "cacheStep")
+                cacheStep = atof(text.c_str());
+            else if (name == "batchSize")
+                batchSize = value;
+            else if (name == "batchWait")
+                batchWait = value;
+            else if (name == "shards")
+                shards = value;
+            else if (name == "shardRule")
+                shardRule = text == "cluster" ? SHARD_CLUSTER : SHARD_RANDOM;
+            else if (name == "shardProbe")
+                shardProbe = value;
+            else if (name == "varianceOrder")
+                varianceOrder = value;
+            else if (name == "resultFormat")
+                resultFormat = ::resultFormat(text);
+            else if (name == "printVectors")
+                printVectors = value;
+            else if (name == "rotation")
+                rotation = rotationMode(text);
+            else if (name == "rotationDims")
+                rotationDims = value;
+            else if (name == "engine")
+                engine = max((int)ENGINE_AUTO, engineKind(text));
+            else if (name == "leafBlocks")
+                leafBlocks = value;
+            else if (name == "hugePages")
+                hugePages = hugePageMode(text);
+            else if (name == "memoryBudget")
+                memoryBudget = value;
+            else if (name == "deltaSize")
+                deltaSize = value;
+            else
+                cerr << "Unknown parameter: " << name << endl;
+        }
+        return true;
+    }
+
+    bool save(const string &filename) const
+    {
+        ofstream file(filename);
+        if (!file.is_open())
+        {
+            cerr << "Error opening file: " << filename << endl;
+            return false;
+        }
+        file << "leafSize=" << leafSize << "\n";
+        file << "numTrees=" << numTrees << "\n";
+        file << "searchBudget=" << searchBudget << "\n";
+        file << "splitRule=" << (splitRule == SPLIT_SPREAD ? "spread" : splitRule == SPLIT_MIDPOINT ? "midpoint" : "variance") << "\n";
+        file << "splitSample=" << splitSample << "\n";
+        file << "storage=" << storageName(storage) << "\n";
+        file << "rerank=" << rerank << "\n";
+        file << "pqSubspaces=" << pqSubspaces << "\n";
+        file << "M=" << M << "\n";
+        file << "efConstruction=" << efConstruction << "\n";
+        file << "efSearch=" << efSearch << "\n";
+        file << "threads=" << threads << "\n";
+        file << "cacheSize=" << cacheSize << "\n";
+        file << "cacheStep=" << cacheStep << "\n";
+        file << "batchSize=" << batchSize << "\n";
+        file << "batchWait=" << batchWait << "\n";
+        file << "shards=" << shards << "\n";
+        file << "shardRule=" << (shardRule == SHARD_CLUSTER ? "cluster" : "random") << "\n";
+        file << "shardProbe=" << shardProbe << "\n";
+        file << "varianceOrder=" << varianceOrder << "\n";
+        file << "resultFormat=" << resultFormatName(resultFormat) << "\n";
+        file << "printVectors=" << printVectors << "\n";
+        file << "rotation=" << rotationName(rotation) << "\n";
+        file << "rotationDims=" << rotationDims << "\n";
+        file << "engine=" << engineName(engine) << "\n";
+        file << "leafBlocks=" << leafBlocks << "\n";
+        file << "hugePages=" << hugePageName(hugePages) << "\n";
+        file << "memoryBudget=" << memoryBudget << "\n";
+        file << "deltaSize=" << deltaSize << "\n";
+        return true;
+    }
+};
+
+// Largest leaf of a tree built with params, and the multiple of rows every leaf starts on: LEAFBLOCK
+// with IndexParams::leafBlocks, so every leaf is made of whole dimension-major blocks (see
+// VectorStore::blockRows), else 1.
+inline int leafAlignment(const IndexParams &params)
+{
+    return params.leafBlocks ? LEAFBLOCK : 1;
+}
+
+inline int leafCapacity(const IndexParams &params)
+{
+    // a node of two points always splits into a leaf of two, so smaller leaves are impossible
+    int align = leafAlignment(params);
+    return (max(2, params.leafSize) + align - 1) / align * align;
+}
+
+// Upper bound of the nodes of a tree over n points whose leaves hold at most leafSize of them: the
+// median splits leave every leaf at least half full.
+inline size_t treeNodes(size_t n, int leafSize)
+{
+    return 2 * (2 * n / max(1, leafSize) + 1);
+}
+
+// Room lost to rounding by blocks arrays mapped on huge pages: the last huge page of each is only
+// partly used at worst.
+inline size_t hugePageSlack(const IndexParams &params, int blocks)
+{
+    return params.hugePages != HUGEPAGES_NONE ? blocks * HUGEPAGESIZE : 0;
+}
+
+// Called by every index before it builds: checks estimate against params.memoryBudget. Returns false,
+// with the breakdown on cerr, when the build does not fit.
+inline bool admitBuild(const MemoryEstimate &estimate, const IndexParams &params)
+{
+    if (params.memoryBudget > 0 && estimate.total() > ((size_t)params.memoryBudget << 20))
+    {
+        cerr << "Build refused, over the memory budget of " << params.memoryBudget << " MB: ";
+        estimate.describe(cerr);
+        cerr << endl;
+        return false;
+    }
+    return true;
+}
+
+// First row of the right half when the rows [begin, end) of a node larger than its leaves are split at
+// the median: just past the middle, or the multiple of align from begin nearest to it, so that both
+// halves start on a multiple of align when begin does.
+inline int medianSplit(int begin, int end, int align)
+{
+    int n = end - begin;
+    int split = n / 2 + 1;
+    if (align > 1)
+    {
+        split = min(max((split + align / 2) / align * align, align), n - 1);
+    }
+    return begin + split;
+}
+
+// Number of worker threads to use for a requested count (0 for one per hardware thread).
+inline int workerCount(int threads)
+{
+    return threads > 0 ? threads : max(1, (int)thread::hardware_concurrency());
+}
+
+// Runs work(i, worker) for every i in [0, n) on workerCount(threads) threads, where worker in
+// [0, workerCount(threads)) names the thread, so per-thread scratch space can be indexed by it. Items
+// are handed out one at a time, so uneven items still spread evenly.
+template <class Work>
+void parallelFor(int n, int threads, Work work)
+{
+    threads = min(workerCount(threads), n);
+    if (threads <= 1)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            work(i, 0);
+        }
+        return;
+    }
+
+    atomic<int> next(0);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.push_back(thread([&, t]() {
+            for (int i = next++; i < n; i = next++)
+            {
+                work(i, t);
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+    }
+}
+
+class TreeIndex
+{
+public:
+    TreeIndex() {}
+    virtual ~TreeIndex() {}
+
+    virtual bool maketree(const vector<DataVector> &points) = 0;
+    virtual vector<DataVector> query_search(const DataVector &point, int k) const = 0;
+    virtual vector<pair<double, int>> knn(const DataVector &point, int k) const = 0;
+    virtual vector<vector<pair<double, int>>> batch_knn(const vector<DataVector> &queries, int k) const = 0;
+    virtual void setParams(const IndexParams &params) = 0;
+    virtual IndexParams getParams() const = 0;
+    virtual bool AddData(DataVector &newpoint, vector<DataVector> &points) = 0;
+    virtual bool DeleteData(DataVector &newpoint, vector<DataVector> &points) = 0;
+    virtual MemoryEstimate estimateMemory(size_t points, int dim) const = 0;
+
+    virtual void setAttributes(shared_ptr<const PointAttributes> newattributes)
+    {
+        atomic_store(&attributes, newattributes);
+    }
+
+    virtual vector<pair<double, int>> filtered_knn(const DataVector &point, int k, const PointFilter &filter) const
+    {
+        vector<pair<double, int>> matching;
+        shared_ptr<const PointAttributes> pinned = pinAttributes();
+        if (!pinned || k <= 0)
+        {
+            return matching;
+        }
+        for (int fetch = 4 * k;; fetch *= 4)
+        {
+            vector<pair<double, int>> nearest = knn(point, fetch);
+            matching.clear();
+            for (size_t i = 0; i < nearest.size() && (int)matching.size() < k; i++)
+            {
+                if (filter.matches(*pinned, nearest[i].second))
+                    matching.push_back(nearest[i]);
+            }
+            // fewer than fetch answers: there is nothing more to fetch
+            if ((int)matching.size() == k || (int)nearest.size() < fetch || fetch >= pinned->size())
+            {
+                return matching;
+            }
+        }
+    }
+
+protected:
+    shared_ptr<const PointAttributes> pinAttributes() const
+    {
+        return atomic_load(&attributes);
+    }
+
+private:
+    shared_ptr<const PointAttributes> attributes;
+
+    TreeIndex(const TreeIndex &);
+    TreeIndex &operator=(const TreeIndex &);
+};
+
+// Points of a built tree, stored row-major in tree order: the points under any node are the
+// contiguous rows [begin, end). ids[i] is the position of row i in the points given to maketree.
+//
+// While a tree is built the rows are kept as doubles in data (row() reads them). finish() then moves
+// them into store, in the storage mode of the index, and every query scans store. With a lossy mode
+// and IndexParams::rerank > 0, an exact float32 copy is kept as well and the best rerank * k
+// candidates are re-scored against it. The rows and ids are HugeVectors, on huge pages with
+// IndexParams::hugePages (setHugePages, see HugePages.h). With leaf blocks the store lays its rows
+// out dimension-major and the scans below score runs of consecutive rows a block at a time.
+struct TreePoints
+{
+    int dim;
+    HugeVector<double> data;
+    VectorStore store;
+    VectorStore exact;
+    HugeVector<int> ids;
+    int rerank;
+
+    TreePoints() : dim(0), rerank(0) {}
+
+    int size() const
+    {
+        return ids.size();
+    }
+
+    const double *row(int i) const
+    {
+        return &data[(size_t)i * dim];
+    }
+
+    DataVector get(int i) const
+    {
+        vector<double> v(dim);
+        (exact.size() > 0 ? exact : store).decode(i, v.data());
+        return DataVector(v);
+    }
+
+    // Number of candidates a query has to keep to answer k: more when they are reranked.
+    int keep(int k) const
+    {
+        return exact.size() > 0 ? k * rerank : k;
+    }
+
+    // Turns (squared distance, row) candidates scored on store into the k nearest (distance, id)
+    // pairs, sorted by distance, re-scoring them exactly first if there is an exact copy.
+    vector<pair<double, int>> answer(const double *point, vector<pair<double, int>> candidates, int k) const
+    {
+        if (exact.size() > 0)
+        {
+            TraceSpan span("rerank");
+            StoreQuery query = exact.prepare(point);
+            for (size_t i = 0; i < candidates.size(); i++)
+            {
+                candidates[i].first = exact.squaredDistance(query, candidates[i].second);
+            }
+        }
+        k = min(k, (int)candidates.size());
+        partial_sort(candidates.begin(), candidates.begin() + k, candidates.end());
+        candidates.resize(k);
+        for (int i = 0; i < k; i++)
+        {
+            candidates[i].first = sqrt(candidates[i].first);
+            candidates[i].second = ids[candidates[i].second];
+        }
+        return candidates;
+    }
+
+    // The k rows nearest to point among rows, as (distance, id) pairs sorted by distance. The rows are
+    // scored with the bounded distance of the store against the worst of the shortlist kept so far,
+    // so most of them are abandoned after a few blocks of features.
+    // With a blocked store, runs of consecutive rows (up to SCANRUN of them) are scored in one call,
+    // against the bound at the start of the run.
+    vector<pair<double, int>> nearest(const double *point, const vector<int> &rows, int k) const
+    {
+        StoreQuery query = store.prepare(point);
+        int shortlist = keep(k);
+        vector<pair<double, int>> best; // max-heap of the shortlist
+        best.reserve(shortlist);
+        {
+            TraceSpan span("scan");
+            double dists[SCANRUN];
+            size_t i = 0;
+            while (i < rows.size() && shortlist > 0)
+            {
+                int n = 1;
+                double bound = (int)best.size() == shortlist ? best.front().first : numeric_limits<double>::infinity();
+                if (store.isBlocked())
+                {
+                    n = runLength(rows, i);
+                    store.squaredDistances(query, rows[i], n, bound, dists);
+                }
+                else
+                {
+                    dists[0] = store.squaredDistance(query, rows[i], bound);
+                }
+                for (int j = 0; j < n; j++, i++)
+                {
+                    // a distance abandoned against the bound is above it, and so above the worst kept
+                    if ((int)best.size() < shortlist)
+                    {
+                        best.push_back(make_pair(dists[j], rows[i]));
+                        push_heap(best.begin(), best.end());
+                    }
+                    else if (dists[j] < best.front().first)
+                    {
+                        pop_heap(best.begin(), best.end());
+                        best.back() = make_pair(dists[j], rows[i]);
+                        push_heap(best.begin(), best.end());
+                    }
+                }
+            }
+        }
+        return answer(point, best, k);
+    }
+
+    // The largest squared distance of query to rows, -1 without rows. Searches call it over every
+    // candidate at every node they back up through, so rows of an unblocked store are taken one at a
+    // time without the bookkeeping of runs.
+    double farthest(const StoreQuery &query, const vector<int> &rows) const
+    {
+        double maxdist = -1;
+        if (!store.isBlocked())
+        {
+            for (size_t i = 0; i < rows.size(); i++)
+            {
+                maxdist = max(maxdist, store.squaredDistance(query, rows[i]));
+            }
+            return maxdist;
+        }
+        double dists[SCANRUN];
+        size_t i = 0;
+        while (i < rows.size())
+        {
+            int n = runLength(rows, i);
+            store.squaredDistances(query, rows[i], n, numeric_limits<double>::infinity(), dists);
+            maxdist = max(maxdist, *max_element(dists, dists + n));
+            i += n;
+        }
+        return maxdist;
+    }
+
+    // Make the buffer, the ids and the stores of the next load() in the HugePageMode mode. Drops the
+    // rows and ids held now.
+    void setHugePages(int mode)
+    {
+        data = HugeVector<double>(HugePageAllocator<double>(mode));
+        ids = HugeVector<int>(HugePageAllocator<int>(mode));
+        store.setHugePages(mode);
+        exact.setHugePages(mode);
+    }
+
+    // Copy points into the buffer in their original order.
+    void load(const vector<DataVector> &points)
+    {
+        dim = points.empty() ? 0 : points[0].getDimension();
+        data.resize((size_t)points.size() * dim);
+        ids.resize(points.size());
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            vector<double> v = points[i].getVector();
+            copy(v.begin(), v.end(), data.begin() + i * dim);
+            ids[i] = i;
+        }
+    }
+
+    // Copy the rotated coordinates of points into the buffer, in their original order.
+    void load(const vector<DataVector> &points, const Rotation &rotation)
+    {
+        dim = rotation.size();
+        data.resize((size_t)points.size() * dim);
+        ids.resize(points.size());
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            vector<double> v = points[i].getVector();
+            rotation.apply(v.data(), &data[i * dim]);
+            ids[i] = i;
+        }
+    }
+
+    // Reorder the rows so that row i becomes the current row order[i].
+    void permute(const vector<int> &order)
+    {
+        HugeVector<double> sorted((size_t)order.size() * dim, 0, data.get_allocator());
+        HugeVector<int> sortedids(order.size(), 0, ids.get_allocator());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            copy(row(order[i]), row(order[i]) + dim, sorted.begin() + i * dim);
+            sortedids[i] = ids[order[i]];
+        }
+        data.swap(sorted);
+        ids.swap(sortedids);
+    }
+
+    // Move the rows into store (see above). data is empty afterwards. subspaces is used by STORE_PQ;
+    // varianceOrder makes the bounded distances of store visit high-variance features first, blocks
+    // lays float64 / float32 rows out in dimension-major blocks.
+    void finish(int mode, int rerankFactor, int subspaces = 0, bool varianceOrder = false, bool blocks = false)
+    {
+        bool lossy = mode == STORE_FLOAT16 || mode == STORE_INT8 || mode == STORE_PQ;
+        rerank = lossy ? max(0, rerankFactor) : 0;
+        if (rerank > 0)
+        {
+            exact.encode(data.data(), size(), dim, STORE_FLOAT32);
+        }
+        else
+        {
+            exact.clear();
+        }
+
+        if (mode == STORE_FLOAT64)
+        {
+            store.adopt(data, size(), dim);
+        }
+        else
+        {
+            store.encode(data.data(), size(), dim, mode, subspaces);
+        }
+        if (varianceOrder)
+        {
+            store.orderBlocksByVariance();
+        }
+        if (blocks)
+        {
+            store.blockRows();
+        }
+        HugeVector<double>(data.get_allocator()).swap(data);
+    }
+
+    // The dataset and ids parts of the estimate of a build over n points (see MemoryBudget.h): the
+    // buffer and its copy in tree order, then the store, exact copy and blocked copy next to them
+    // (see finish).
+    static MemoryEstimate estimate(size_t n, int dim, const IndexParams &params, bool blocks = false)
+    {
+        MemoryEstimate memory;
+        size_t buffer = n * dim * sizeof(double);
+        bool lossy = params.storage == STORE_FLOAT16 || params.storage == STORE_INT8 || params.storage == STORE_PQ;
+        size_t stored = VectorStore::estimateBytes(n, dim, params.storage, params.pqSubspaces);
+        size_t finished = buffer + (params.storage == STORE_FLOAT64 ? 0 : stored) +
+                          (lossy && params.rerank > 0 ? n * dim * sizeof(float) : 0) + (blocks ? stored : 0);
+        memory.dataset = max(2 * buffer, finished) + n * sizeof(double) + hugePageSlack(params, 4);
+        memory.ids = 2 * n * sizeof(int) + hugePageSlack(params, 2);
+        return memory;
+    }
+
+private:
+    static const int SCANRUN = 8 * LEAFBLOCK;
+
+    // Number of rows from rows[i] on that are consecutive, at most SCANRUN.
+    int runLength(const vector<int> &rows, size_t i) const
+    {
+        int n = 1;
+        while (n < SCANRUN && i + n < rows.size() && rows[i + n] == rows[i] + n)
+        {
+            n++;
+        }
+        return n;
+    }
+};
+
+// Holder for the published tree of an index. Readers pin() the current version, writers
+// publish() a new one; the previous version is freed once its last reader lets go. Both go through
+// the atomic_load / atomic_store overloads for shared_ptr, which lock around the pointer copy (see
+// the concurrency model above); C++20 replaces them with atomic<shared_ptr>.
+template <class Tree>
+class Snapshot
+{
+    shared_ptr<const Tree> current;
+
+public:
+    shared_ptr<const Tree> pin() const
+    {
+        return atomic_load(&current);
+    }
+
+    void publish(shared_ptr<const Tree> tree)
+    {
+        atomic_store(&current, tree);
+    }
+};
+
+#endif
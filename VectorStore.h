@@ -0,0 +1,720 @@
+/*
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ____________________________*VectorStore* : The VectorStore class____________________________
+    ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    VectorStore.h contains the row storage the indexes scan: a flat array of vectors in one of five
+    formats (StorageMode), row-major unless blocked (see below).
+
+        - STORE_FLOAT64: 8 bytes per coordinate, exact.
+        - STORE_FLOAT32: 4 bytes per coordinate.
+        - STORE_FLOAT16: 2 bytes per coordinate (IEEE half precision).
+        - STORE_INT8:    1 byte per coordinate, scalar quantized: every feature is mapped linearly from
+                         its [min, max] over the stored rows onto 256 levels.
+        - STORE_PQ:      1 byte per subspace, product quantized: the features are cut into subspaces
+                         of consecutive features, and every subspace of a row is replaced by the
+                         nearest of 256 centroids trained with k-means on (a sample of) the rows.
+                         With dim / 4 subspaces a row takes 1/32 of its float64 size.
+
+    The rows live on huge pages when IndexParams::hugePages asks for them (setHugePages, see
+    HugePages.h).
+
+    Distances are computed between a full-precision query and the stored codes without decoding the
+    rows first, with AVX2/FMA/F16C kernels where the compiler targets them (-march=native) and scalar
+    loops otherwise. For STORE_PQ, prepare() computes the distance of every subspace of the query to
+    every centroid once (the lookup table), and the distance to a row is the sum of one table entry
+    per subspace (asymmetric distance computation).
+
+    float64 and float32 rows can instead be laid out dimension-major in blocks of LEAFBLOCK rows
+    (blockRows): feature d of the rows [b, b + LEAFBLOCK) is stored contiguously, so the vertical
+    kernels (blockSquaredDistances) score a whole block in one pass over the features. A tree whose
+    leaves start on a multiple of LEAFBLOCK then scans every leaf a block at a time. Single rows are
+    still readable, with a stride of LEAFBLOCK between features.
+
+    - Member Functions:
+
+        - void encode(const double* data, int rows, int dim, int mode, int subspaces = 0):
+            Description:
+                Replace the contents with rows x dim values, stored in mode. subspaces is the number
+                of subspaces of STORE_PQ (0 for dim / 4).
+
+        - void adopt(HugeVector<double>& data, int rows, int dim):
+            Description:
+                Take over a float64 buffer without copying it, and the huge page mode it was made in.
+
+        - StoreQuery prepare(const double* point) const:
+            Description:
+                Convert a query once into the form the distance kernel of the mode wants.
+
+        - double squaredDistance(const StoreQuery& query, int row) const:
+            Description:
+                Squared distance between a prepared query and a stored row.
+
+        - double squaredDistance(const StoreQuery& query, int row, double bound) const:
+            Description:
+                The same, abandoned early: the features are summed DISTANCEBLOCK at a time and the
+                partial sum is returned as soon as it exceeds bound, so a row that can not beat the
+                current k-th best costs only the blocks needed to tell. The result is exact whenever
+                it is at most bound. STORE_PQ rows, rows shorter than BOUNDEDMINDIM and single blocked
+                rows are always summed in full.
+
+        - void squaredDistances(const StoreQuery& query, int begin, int count, double bound, double* out) const:
+            Description:
+                squaredDistance(query, row, bound) of the count consecutive rows from begin, in out.
+                One call for both layouts: blocked rows go through the vertical kernels a block at a
+                time, row-major rows one by one. A block is abandoned, DISTANCEBLOCK features at a
+                time, once all of its rows are past bound.
+
+        - void blockRows():
+            Description:
+                Switch float64 and float32 rows to the dimension-major layout, padded with zero rows
+                to a multiple of LEAFBLOCK. Does nothing in the other modes.
+
+        - void orderBlocksByVariance():
+            Description:
+                Make the bounded distance visit the blocks of features in decreasing order of their
+                variance over the stored rows, so the partial sum grows fastest and rows are
+                abandoned sooner. By default the blocks are visited in feature order.
+
+        - void decode(int row, double* out) const:
+            Description:
+                Write the (approximate, for lossy modes) values of a row to out.
+
+        - const double* rows(int begin, int count, vector<double>& scratch) const:
+            Description:
+                The values of count consecutive rows as doubles: a pointer into the store for
+                row-major float64, or decoded into scratch otherwise.
+
+        - void setHugePages(int mode):
+            Description:
+                The HugePageMode of the rows stored from now on (HUGEPAGES_NONE at first).
+
+        - static size_t estimateBytes(size_t rows, int dim, int mode, int subspaces = 0):
+            Description:
+                Bytes of rows x dim values stored in mode, before encoding them.
+
+        - vector<double> norms:
+            The squared norm of every decoded row.
+*/
+
+#ifndef VECTORSTORE_H
+#define VECTORSTORE_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include "DistanceKernels.h"
+#include "HugePages.h"
+
+using namespace std;
+
+enum StorageMode
+{
+    STORE_FLOAT64,
+    STORE_FLOAT32,
+    STORE_FLOAT16,
+    STORE_INT8,
+    STORE_PQ
+};
+
+inline const char *storageName(int mode)
+{
+    switch (mode)
+    {
+    case STORE_FLOAT32:
+        return "float32";
+    case STORE_FLOAT16:
+        return "float16";
+    case STORE_INT8:
+        return "int8";
+    case STORE_PQ:
+        return "pq";
+    default:
+        return "float64";
+    }
+}
+
+inline int storageMode(const string &name)
+{
+    if (name == "float32")
+        return STORE_FLOAT32;
+    if (name == "float16")
+        return STORE_FLOAT16;
+    if (name == "int8")
+        return STORE_INT8;
+    if (name == "pq")
+        return STORE_PQ;
+    return STORE_FLOAT64;
+}
+
+// Smallest dimension the bounded distance abandons rows at. The vector kernels are cheap enough that
+// the branches of the blocks only pay for themselves on long rows.
+#if defined(__AVX2__) && defined(__FMA__)
+const int BOUNDEDMINDIM = 256;
+#else
+const int BOUNDEDMINDIM = 32;
+#endif
+
+// A query in the form the kernel of a store wants: the values themselves as doubles and floats,
+// for STORE_INT8 the values shifted by the quantizer offset (a[i] = q[i] - offset[i] - 128 scale[i]),
+// for STORE_PQ the lookup table (table[s * 256 + c] = squared distance of subspace s to centroid c).
+struct StoreQuery
+{
+    const double *f64;
+    vector<float> f32;
+    vector<float> table;
+};
+
+class VectorStore
+{
+    int mode;
+    int dim;
+    int count;
+    bool blocked; // float64 / float32 rows laid out dimension-major, LEAFBLOCK rows per block
+    int pages;    // HugePageMode of the rows
+    HugeVector<double> f64;
+    HugeVector<float> f32;
+    HugeVector<uint16_t> f16;
+    HugeVector<int8_t> i8;
+    vector<float> offset, scale; // STORE_INT8: value = offset + scale * (code + 128)
+    // STORE_PQ: subspace s holds the features [bounds[s], bounds[s + 1]); its 256 centroids start at
+    // codebooks[256 * bounds[s]], each of bounds[s + 1] - bounds[s] floats
+    vector<int> bounds;
+    vector<float> codebooks;
+    HugeVector<uint8_t> pq;
+    // first feature of every DISTANCEBLOCK-wide block, in the order bounded distances visit them
+    vector<int> blockOrder;
+
+public:
+    static const int DISTANCEBLOCK = 16;
+
+    vector<double> norms;
+
+    VectorStore() : mode(STORE_FLOAT64), dim(0), count(0), blocked(false), pages(HUGEPAGES_NONE) {}
+
+    int getMode() const { return mode; }
+    int size() const { return count; }
+    bool isBlocked() const { return blocked; }
+
+    // Bytes the rows of encode(rows x dim, storage, subspaces) take (not counting norms).
+    static size_t estimateBytes(size_t rows, int dim, int storage, int subspaces = 0)
+    {
+        size_t values = rows * dim;
+        switch (storage)
+        {
+        case STORE_FLOAT32:
+            return values * sizeof(float);
+        case STORE_FLOAT16:
+            return values * sizeof(uint16_t);
+        case STORE_INT8:
+            return values + 2 * dim * sizeof(float);
+        case STORE_PQ:
+            return rows * max(1, min(subspaces > 0 ? subspaces : dim / 4, dim)) + 256 * (size_t)dim * sizeof(float);
+        default:
+            return values * sizeof(double);
+        }
+    }
+
+    // Bytes used by the rows (not counting norms).
+    size_t bytes() const
+    {
+        return f64.size() * sizeof(double) + f32.size() * sizeof(float) + f16.size() * sizeof(uint16_t) +
+               i8.size() + (offset.size() + scale.size()) * sizeof(float) + pq.size() +
+               codebooks.size() * sizeof(float);
+    }
+
+    void setHugePages(int mode)
+    {
+        pages = mode;
+    }
+
+    void clear()
+    {
+        HugeVector<double>(HugePageAllocator<double>(pages)).swap(f64);
+        HugeVector<float>(HugePageAllocator<float>(pages)).swap(f32);
+        HugeVector<uint16_t>(HugePageAllocator<uint16_t>(pages)).swap(f16);
+        HugeVector<int8_t>(HugePageAllocator<int8_t>(pages)).swap(i8);
+        HugeVector<uint8_t>(HugePageAllocator<uint8_t>(pages)).swap(pq);
+        vector<float>().swap(codebooks);
+        vector<double>().swap(norms);
+        blockOrder.clear();
+        count = 0;
+        blocked = false;
+    }
+
+    void encode(const double *data, int rows, int dimension, int storage, int subspaces = 0)
+    {
+        clear();
+        mode = storage;
+        dim = dimension;
+        count = rows;
+        size_t n = (size_t)rows * dim;
+
+        switch (mode)
+        {
+        case STORE_FLOAT32:
+            f32.resize(n);
+            for (size_t i = 0; i < n; i++)
+                f32[i] = (float)data[i];
+            break;
+        case STORE_FLOAT16:
+            f16.resize(n);
+            for (size_t i = 0; i < n; i++)
+                f16[i] = floatToHalf((float)data[i]);
+            break;
+        case STORE_INT8:
+        {
+            offset.assign(dim, 0);
+            scale.assign(dim, 0);
+            for (int d = 0; d < dim && rows > 0; d++)
+            {
+                double lo = data[d], hi = data[d];
+                for (int r = 1; r < rows; r++)
+                {
+                    lo = min(lo, data[(size_t)r * dim + d]);
+                    hi = max(hi, data[(size_t)r * dim + d]);
+                }
+                offset[d] = (float)lo;
+                scale[d] = (float)((hi - lo) / 255);
+            }
+            i8.resize(n);
+            for (int r = 0; r < rows; r++)
+            {
+                for (int d = 0; d < dim; d++)
+                {
+                    double level = scale[d] > 0 ? (data[(size_t)r * dim + d] - offset[d]) / scale[d] : 0;
+                    i8[(size_t)r * dim + d] = (int8_t)(min(255.0, max(0.0, round(level))) - 128);
+                }
+            }
+            break;
+        }
+        case STORE_PQ:
+            trainProductQuantizer(data, rows, subspaces);
+            pq.resize((size_t)rows * (bounds.size() - 1));
+            for (int r = 0; r < rows; r++)
+            {
+                for (size_t sub = 0; sub + 1 < bounds.size(); sub++)
+                {
+                    pq[(size_t)r * (bounds.size() - 1) + sub] = nearestCentroid(sub, data + (size_t)r * dim);
+                }
+            }
+            break;
+        default:
+            f64.assign(data, data + n);
+            break;
+        }
+        computeNorms();
+        orderBlocks(vector<double>());
+    }
+
+    void adopt(HugeVector<double> &data, int rows, int dimension)
+    {
+        clear();
+        mode = STORE_FLOAT64;
+        dim = dimension;
+        count = rows;
+        f64.swap(data);
+        computeNorms();
+        orderBlocks(vector<double>());
+    }
+
+    StoreQuery prepare(const double *point) const
+    {
+        StoreQuery query;
+        query.f64 = point;
+        if (mode == STORE_INT8)
+        {
+            query.f32.resize(dim);
+            for (int d = 0; d < dim; d++)
+                query.f32[d] = (float)(point[d] - offset[d] - 128.0 * scale[d]);
+        }
+        else if (mode == STORE_PQ)
+        {
+            query.table.resize((bounds.size() - 1) * 256);
+            for (size_t sub = 0; sub + 1 < bounds.size(); sub++)
+            {
+                int width = bounds[sub + 1] - bounds[sub];
+                const double *q = point + bounds[sub];
+                const float *centroid = &codebooks[256 * (size_t)bounds[sub]];
+                for (int c = 0; c < 256; c++, centroid += width)
+                {
+                    double sum = 0;
+                    for (int d = 0; d < width; d++)
+                    {
+                        double diff = q[d] - centroid[d];
+                        sum += diff * diff;
+                    }
+                    query.table[sub * 256 + c] = (float)sum;
+                }
+            }
+        }
+        else if (mode != STORE_FLOAT64)
+        {
+            query.f32.assign(point, point + dim);
+        }
+        return query;
+    }
+
+    double squaredDistance(const StoreQuery &query, int row) const
+    {
+        if (blocked)
+        {
+            return stridedDistance(query, row);
+        }
+        size_t at = (size_t)row * dim;
+        switch (mode)
+        {
+        case STORE_FLOAT32:
+            return squaredDistanceF32(query.f32.data(), &f32[at], dim);
+        case STORE_FLOAT16:
+            return squaredDistanceF16(query.f32.data(), &f16[at], dim);
+        case STORE_INT8:
+            return squaredDistanceI8(query.f32.data(), scale.data(), &i8[at], dim);
+        case STORE_PQ:
+        {
+            int m = bounds.size() - 1;
+            return squaredDistancePQ(query.table.data(), &pq[(size_t)row * m], m);
+        }
+        default:
+            return ::squaredDistance(query.f64, &f64[at], dim);
+        }
+    }
+
+    double squaredDistance(const StoreQuery &query, int row, double bound) const
+    {
+        if (mode == STORE_PQ || dim < BOUNDEDMINDIM || blocked)
+        {
+            return squaredDistance(query, row);
+        }
+        size_t at = (size_t)row * dim;
+        int blocks = blockOrder.size();
+        const int *order = blockOrder.data();
+        double sum = 0;
+        switch (mode)
+        {
+        case STORE_FLOAT32:
+            for (int b = 0; b < blocks && sum <= bound; b++)
+                sum += squaredDistanceF32(&query.f32[order[b]], &f32[at + order[b]], min(DISTANCEBLOCK, dim - order[b]));
+            break;
+        case STORE_FLOAT16:
+            for (int b = 0; b < blocks && sum <= bound; b++)
+                sum += squaredDistanceF16(&query.f32[order[b]], &f16[at + order[b]], min(DISTANCEBLOCK, dim - order[b]));
+            break;
+        case STORE_INT8:
+            for (int b = 0; b < blocks && sum <= bound; b++)
+                sum += squaredDistanceI8(&query.f32[order[b]], &scale[order[b]], &i8[at + order[b]], min(DISTANCEBLOCK, dim - order[b]));
+            break;
+        default:
+            for (int b = 0; b < blocks && sum <= bound; b++)
+                sum += ::squaredDistance(query.f64 + order[b], &f64[at + order[b]], min(DISTANCEBLOCK, dim - order[b]));
+            break;
+        }
+        return sum;
+    }
+
+    void squaredDistances(const StoreQuery &query, int begin, int n, double bound, double *out) const
+    {
+        if (!blocked)
+        {
+            for (int r = 0; r < n; r++)
+            {
+                out[r] = squaredDistance(query, begin + r, bound);
+            }
+            return;
+        }
+        double block[LEAFBLOCK], part[LEAFBLOCK];
+        int end = begin + n;
+        bool bounded = dim >= BOUNDEDMINDIM && bound < numeric_limits<double>::infinity();
+        for (int first = begin - begin % LEAFBLOCK; first < end; first += LEAFBLOCK)
+        {
+            // the lanes of the block holding rows asked for
+            int lo = max(first, begin) - first, hi = min(first + LEAFBLOCK, end) - first;
+            if (!bounded)
+            {
+                blockDistances(query, first, 0, dim, block);
+            }
+            else
+            {
+                // as the bounded distance of a row: stop once every row asked for is past bound
+                fill(block, block + LEAFBLOCK, 0.0);
+                for (size_t b = 0; b < blockOrder.size() && *min_element(block + lo, block + hi) <= bound; b++)
+                {
+                    blockDistances(query, first, blockOrder[b], min(DISTANCEBLOCK, dim - blockOrder[b]), part);
+                    for (int j = 0; j < LEAFBLOCK; j++)
+                        block[j] += part[j];
+                }
+            }
+            copy(block + lo, block + hi, out + first + lo - begin);
+        }
+    }
+
+    void blockRows()
+    {
+        if (blocked || (mode != STORE_FLOAT64 && mode != STORE_FLOAT32))
+        {
+            return;
+        }
+        size_t padded = (size_t)(count + LEAFBLOCK - 1) / LEAFBLOCK * LEAFBLOCK;
+        if (mode == STORE_FLOAT32)
+        {
+            HugeVector<float> transposed(padded * dim, 0, f32.get_allocator());
+            for (int r = 0; r < count; r++)
+            {
+                for (int d = 0; d < dim; d++)
+                    transposed[blockOffset(r, d)] = f32[(size_t)r * dim + d];
+            }
+            f32.swap(transposed);
+        }
+        else
+        {
+            HugeVector<double> transposed(padded * dim, 0, f64.get_allocator());
+            for (int r = 0; r < count; r++)
+            {
+                for (int d = 0; d < dim; d++)
+                    transposed[blockOffset(r, d)] = f64[(size_t)r * dim + d];
+            }
+            f64.swap(transposed);
+        }
+        blocked = true;
+    }
+
+    void orderBlocksByVariance()
+    {
+        vector<double> mean(dim, 0), variance(dim, 0), row(dim);
+        for (int r = 0; r < count; r++)
+        {
+            decode(r, row.data());
+            for (int d = 0; d < dim; d++)
+                mean[d] += row[d];
+        }
+        for (int d = 0; d < dim && count > 0; d++)
+            mean[d] /= count;
+        for (int r = 0; r < count; r++)
+        {
+            decode(r, row.data());
+            for (int d = 0; d < dim; d++)
+                variance[d] += (row[d] - mean[d]) * (row[d] - mean[d]);
+        }
+        orderBlocks(variance);
+    }
+
+    void decode(int row, double *out) const
+    {
+        if (blocked)
+        {
+            for (int d = 0; d < dim; d++)
+                out[d] = mode == STORE_FLOAT32 ? f32[blockOffset(row, d)] : f64[blockOffset(row, d)];
+            return;
+        }
+        size_t at = (size_t)row * dim;
+        switch (mode)
+        {
+        case STORE_FLOAT32:
+            for (int d = 0; d < dim; d++)
+                out[d] = f32[at + d];
+            break;
+        case STORE_FLOAT16:
+            for (int d = 0; d < dim; d++)
+                out[d] = halfToFloat(f16[at + d]);
+            break;
+        case STORE_INT8:
+            for (int d = 0; d < dim; d++)
+                out[d] = offset[d] + (double)scale[d] * (i8[at + d] + 128);
+            break;
+        case STORE_PQ:
+        {
+            int m = bounds.size() - 1;
+            for (int sub = 0; sub < m; sub++)
+            {
+                int width = bounds[sub + 1] - bounds[sub];
+                const float *centroid = &codebooks[256 * (size_t)bounds[sub] + (size_t)pq[(size_t)row * m + sub] * width];
+                for (int d = 0; d < width; d++)
+                    out[bounds[sub] + d] = centroid[d];
+            }
+            break;
+        }
+        default:
+            copy(&f64[at], &f64[at] + dim, out);
+            break;
+        }
+    }
+
+    const double *rows(int begin, int n, vector<double> &scratch) const
+    {
+        if (mode == STORE_FLOAT64 && !blocked)
+        {
+            return &f64[(size_t)begin * dim];
+        }
+        scratch.resize((size_t)n * dim);
+        for (int r = 0; r < n; r++)
+        {
+            decode(begin + r, &scratch[(size_t)r * dim]);
+        }
+        return scratch.data();
+    }
+
+private:
+    // Position of feature d of row in the blocked layout.
+    size_t blockOffset(int row, int d) const
+    {
+        return ((size_t)(row - row % LEAFBLOCK) * dim + (size_t)d * LEAFBLOCK) + row % LEAFBLOCK;
+    }
+
+    // Squared distances over the features [from, from + width) of the LEAFBLOCK rows of the block
+    // holding row first, a multiple of LEAFBLOCK.
+    void blockDistances(const StoreQuery &query, int first, int from, int width, double *out) const
+    {
+        // the block of row first starts at first * dim, the rows before it taking dim values each
+        size_t at = (size_t)first * dim + (size_t)from * LEAFBLOCK;
+        if (mode == STORE_FLOAT32)
+            blockSquaredDistancesF32(query.f32.data() + from, &f32[at], width, out);
+        else
+            blockSquaredDistances(query.f64 + from, &f64[at], width, out);
+    }
+
+    // squaredDistance of one blocked row, its features LEAFBLOCK apart.
+    double stridedDistance(const StoreQuery &query, int row) const
+    {
+        double sum = 0;
+        size_t at = blockOffset(row, 0);
+        for (int d = 0; d < dim; d++, at += LEAFBLOCK)
+        {
+            double diff = query.f64[d] - (mode == STORE_FLOAT32 ? f32[at] : f64[at]);
+            sum += diff * diff;
+        }
+        return sum;
+    }
+
+    // Cut the features into blocks of DISTANCEBLOCK and order them by decreasing total weight, or in
+    // feature order without weights.
+    void orderBlocks(const vector<double> &weights)
+    {
+        vector<pair<double, int>> blocks;
+        for (int d = 0; d < dim; d += DISTANCEBLOCK)
+        {
+            double weight = 0;
+            for (int i = d; i < min(dim, d + DISTANCEBLOCK) && !weights.empty(); i++)
+                weight += weights[i];
+            blocks.push_back(make_pair(-weight, d));
+        }
+        stable_sort(blocks.begin(), blocks.end());
+        blockOrder.resize(blocks.size());
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            blockOrder[b] = blocks[b].second;
+        }
+    }
+
+    // Index of the centroid of subspace sub nearest to the features of row.
+    uint8_t nearestCentroid(int sub, const double *row) const
+    {
+        int width = bounds[sub + 1] - bounds[sub];
+        const double *x = row + bounds[sub];
+        const float *centroid = &codebooks[256 * (size_t)bounds[sub]];
+        int best = 0;
+        double bestDist = numeric_limits<double>::infinity();
+        for (int c = 0; c < 256; c++, centroid += width)
+        {
+            double sum = 0;
+            for (int d = 0; d < width && sum < bestDist; d++)
+            {
+                double diff = x[d] - centroid[d];
+                sum += diff * diff;
+            }
+            if (sum < bestDist)
+            {
+                bestDist = sum;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+    // Cut the features into subspaces and train 256 centroids per subspace with k-means (Lloyd's
+    // iterations) on a random sample of at most PQSAMPLE rows. With fewer distinct rows than 256 some
+    // centroids repeat, which costs nothing but table entries.
+    void trainProductQuantizer(const double *data, int rows, int subspaces)
+    {
+        const int PQSAMPLE = 8192, ITERATIONS = 10;
+        int m = subspaces > 0 ? subspaces : max(1, dim / 4);
+        m = max(1, min(m, dim));
+        bounds.resize(m + 1);
+        for (int sub = 0; sub <= m; sub++)
+        {
+            bounds[sub] = (long long)sub * dim / m;
+        }
+        codebooks.assign(256 * (size_t)dim, 0);
+        if (rows == 0)
+        {
+            return;
+        }
+
+        mt19937 gen(5489u);
+        vector<int> sample(rows);
+        for (int r = 0; r < rows; r++)
+        {
+            sample[r] = r;
+        }
+        shuffle(sample.begin(), sample.end(), gen);
+        sample.resize(min(rows, PQSAMPLE));
+        int n = sample.size();
+
+        vector<uint8_t> assigned(n);
+        vector<double> sums;
+        vector<int> counts(256);
+        for (int sub = 0; sub < m; sub++)
+        {
+            int width = bounds[sub + 1] - bounds[sub];
+            float *centroids = &codebooks[256 * (size_t)bounds[sub]];
+            // start from distinct sample rows
+            for (int c = 0; c < 256; c++)
+            {
+                const double *x = data + (size_t)sample[c % n] * dim + bounds[sub];
+                for (int d = 0; d < width; d++)
+                    centroids[c * width + d] = x[d];
+            }
+
+            for (int it = 0; it < ITERATIONS; it++)
+            {
+                for (int i = 0; i < n; i++)
+                {
+                    assigned[i] = nearestCentroid(sub, data + (size_t)sample[i] * dim);
+                }
+                sums.assign(256 * (size_t)width, 0);
+                fill(counts.begin(), counts.end(), 0);
+                for (int i = 0; i < n; i++)
+                {
+                    const double *x = data + (size_t)sample[i] * dim + bounds[sub];
+                    for (int d = 0; d < width; d++)
+                        sums[assigned[i] * width + d] += x[d];
+                    counts[assigned[i]]++;
+                }
+                for (int c = 0; c < 256; c++)
+                {
+                    // an empty cluster restarts from a random sample row
+                    const double *x = data + (size_t)sample[uniform_int_distribution<int>(0, n - 1)(gen)] * dim + bounds[sub];
+                    for (int d = 0; d < width; d++)
+                        centroids[c * width + d] = counts[c] > 0 ? sums[c * width + d] / counts[c] : x[d];
+                }
+            }
+        }
+    }
+
+    void computeNorms()
+    {
+        norms.resize(count);
+        vector<double> row(dim);
+        for (int r = 0; r < count; r++)
+        {
+            decode(r, row.data());
+            norms[r] = dotProduct(row.data(), row.data(), dim);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <fstream>
+#include <random>
+#include "KDTreeIndex.h"
+#include "RPTreeIndex.h"
+#include "AutoTuner.h"
+#include "DataVector.h"
+#include "VectorDataset.h"
+
+using namespace std;
+
+const int MAXSAMPLE = 20000;
+const int MAXQUERIES = 200;
+
+// Random subset of at most n points of data.
+vector<DataVector> sampleOf(const vector<DataVector> &data, int n, mt19937 &gen)
+{
+    vector<DataVector> sample(data);
+    shuffle(sample.begin(), sample.end(), gen);
+    if ((int)sample.size() > n)
+    {
+        sample.resize(n);
+    }
+    return sample;
+}
+
+int main()
+{
+    traceFromEnvironment();
+    string engine = "";
+    cout<<"Enter the index to tune (kd or rp):\n";
+    cin>>engine;
+
+    string testfilename = "";
+    cout<<"Enter only the test filename (location) in a line:\n";
+    cin>>testfilename;
+
+    string trainfilename = "";
+    cout<<"Enter only the train filename (location) in a line:\n";
+    cin>>trainfilename;
+
+    int k = 5;
+    cout<<"Enter the value of k:\n";
+    cin>>k;
+
+    double target = 0.9;
+    cout<<"Enter the target recall (0 to 1):\n";
+    cin>>target;
+
+    string configfile;
+    cout<<"Enter only the output config filename (location) in a line:\n";
+    cin>>configfile;
+
+    VectorDataset test;
+    test.readCSV(testfilename);
+    VectorDataset train;
+    train.readCSV(trainfilename);
+
+    mt19937 gen(42);
+    vector<DataVector> sample = sampleOf(train.getDataset(), MAXSAMPLE, gen);
+    vector<DataVector> queries = sampleOf(test.getDataset(), MAXQUERIES, gen);
+    k = min(k, static_cast<int>(sample.size()));
+
+    TuneGrid grid;
+    IndexParams best;
+    if (engine == "kd")
+    {
+        // a KD-tree is deterministic, more copies of it find nothing new
+        grid.treeCounts.assign(1, 1);
+        KDTreeIndex index;
+        best = autotune(index, sample, queries, k, target, grid, cout);
+    }
+    else if (engine == "rp")
+    {
+        RPTreeIndex index;
+        best = autotune(index, sample, queries, k, target, grid, cout);
+    }
+    else
+    {
+        cerr << "Unknown index: " << engine << endl;
+        return 1;
+    }
+
+    if (!best.save(configfile))
+    {
+        return 1;
+    }
+    cout << "Configuration written to " << configfile << endl;
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include "DualTreeJoin.h"
+#include "ResultSink.h"
+#include "DataVector.h"
+#include "VectorDataset.h"
+
+using namespace std;
+using namespace chrono;
+
+// Usage: join [config]
+// The k nearest training vectors of every test vector, with one dual-tree join (see DualTreeJoin.h).
+// config is an IndexParams file; its threads are used, and its leafSize if it is at least 8 (tree
+// leaves of a join want a few dozen points). With resultFormat=vecs or csv the answers go to
+// <output>.ivecs/.fvecs or <output>.csv instead of the output file.
+int main(int argc, char *argv[])
+{
+    traceFromEnvironment();
+    IndexParams params;
+    if (argc > 1 && !params.load(argv[1]))
+    {
+        return 1;
+    }
+
+    string testfilename = "";
+    cout<<"Enter only the test filename (location) in a line:\n";
+    cin>>testfilename;
+
+    string trainfilename = "";
+    cout<<"Enter only the train filename (location) in a line:\n";
+    cin>>trainfilename;
+
+    int k = 5;
+    cout<<"Enter the value of k:\n";
+    cin>>k;
+
+    string outfile;
+    cout<<"Enter only the output filename (location) in a line:\n";
+    cin>>outfile;
+    ofstream file(outfile, ios::app);
+    if (!file.is_open())
+    {
+        cout << "Unable to open file" << endl;
+    }
+
+    VectorDataset test;
+    test.readCSV(testfilename);
+    VectorDataset train;
+    train.readCSV(trainfilename);
+    k = min(k, static_cast<int>(train.getDataset().size()));
+
+    int leafSize = params.leafSize >= 8 ? params.leafSize : 32;
+    auto start = high_resolution_clock::now();
+    vector<vector<pair<double, int>>> result = allKnnJoin(test.getDataset(), train.getDataset(), k, leafSize, params.threads);
+    auto stop = high_resolution_clock::now();
+
+    if (params.resultFormat != RESULT_NONE)
+    {
+        ResultSink sink;
+        if (sink.open(outfile, params.resultFormat))
+        {
+            for (size_t i = 0; i < result.size(); i++)
+            {
+                sink.write(i, result[i]);
+            }
+            sink.close();
+        }
+    }
+    else
+    {
+        TraceSpan span("output");
+        for (size_t i = 0; i < result.size(); i++)
+        {
+            file << "index of vector: " << i << endl;
+            for (size_t j = 0; j < result[i].size(); j++)
+            {
+                file << result[i][j].second << " " << result[i][j].first << "\n";
+            }
+        }
+    }
+    auto duration = duration_cast<milliseconds>(stop - start);
+    file << "Time taken to join all " << result.size() << " test vectors: " << duration.count() << " milliseconds\n\n";
+    file.close();
+
+    cout << "\nTime taken to join all " << result.size() << " test vectors: " << duration.count() << " milliseconds\n\n";
+    return 0;
+}
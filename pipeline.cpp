@@ -0,0 +1,69 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include "EngineSelector.h"
+#include "Pipeline.h"
+#include "ResultSink.h"
+#include "DataVector.h"
+
+using namespace std;
+
+// Usage: pipeline <kd|rp|ball|hnsw|bf> <train.csv> <test.csv> <k> <output> [config|-]
+// Cold start with the stages overlapped (see Pipeline.h): the training file is parsed on several
+// threads, the test file loads during the build and its first queries are answered as soon as the
+// index is published. The answers go to <output>.ivecs/.fvecs, or <output>.csv with resultFormat=csv
+// in config; the time every stage finished is reported on stderr.
+int main(int argc, char *argv[])
+{
+    traceFromEnvironment();
+    if (argc < 6)
+    {
+        cerr << "Usage: " << argv[0] << " <kd|rp|ball|hnsw|bf> <train.csv> <test.csv> <k> <output> [config|-]" << endl;
+        return 1;
+    }
+    string engine = argv[1];
+    int k = atoi(argv[4]);
+    IndexParams params;
+    if (argc > 6 && string(argv[6]) != "-" && !params.load(argv[6]))
+    {
+        return 1;
+    }
+
+    // the index has to exist before the first point is loaded, so auto can not be used here
+    unique_ptr<TreeIndex> index(makeEngine(max((int)ENGINE_AUTO, engineKind(engine)), params));
+    if (!index)
+    {
+        cerr << "Unknown index: " << engine << endl;
+        return 1;
+    }
+
+    ResultSink sink;
+    if (!sink.open(argv[5], params.resultFormat == RESULT_NONE ? RESULT_VECS : params.resultFormat))
+    {
+        return 1;
+    }
+    PipelineTimes times = runPipeline(*index, argv[2], argv[3], k, params.threads,
+                                      [&sink](int first, const vector<vector<pair<double, int>>> &answers) {
+                                          for (size_t q = 0; q < answers.size(); q++)
+                                          {
+                                              sink.write(first + q, answers[q]);
+                                          }
+                                      });
+    if (!sink.close())
+    {
+        cerr << "Error writing the answers to " << argv[5] << endl;
+        return 1;
+    }
+    if (times.points == 0)
+    {
+        return 1;
+    }
+
+    cerr << "Loaded " << times.points << " points after " << (int)times.loaded << " milliseconds" << endl;
+    cerr << "Index published after " << (int)times.built << " milliseconds" << endl;
+    cerr << "First answer after " << (int)times.firstAnswer << " milliseconds" << endl;
+    cerr << "Answered " << times.queries << " queries after " << (int)times.answered << " milliseconds" << endl;
+    return 0;
+}
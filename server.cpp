@@ -0,0 +1,139 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "EngineSelector.h"
+#include "QueryCache.h"
+#include "QueryServer.h"
+#include "Pipeline.h"
+#include "DataVector.h"
+
+using namespace std;
+using namespace chrono;
+
+// Usage: server <auto|kd|rp|ball|hnsw|bf> <train.csv> [config|-] [socket]
+// Builds the index once and answers binary k-NN requests (see QueryServer.h) on the Unix domain
+// socket, or on stdin / stdout without one. Messages go to stderr. With auto the index is chosen from
+// the training points (see EngineSelector.h).
+int main(int argc, char *argv[])
+{
+    traceFromEnvironment();
+    if (argc < 3)
+    {
+        cerr << "Usage: " << argv[0] << " <auto|kd|rp|ball|hnsw|bf> <train.csv> [config|-] [socket]" << endl;
+        return 1;
+    }
+    string engine = argv[1];
+    IndexParams params;
+    if (argc > 3 && string(argv[3]) != "-" && !params.load(argv[3]))
+    {
+        return 1;
+    }
+
+    int kind = engineKind(engine);
+    if (kind < 0)
+    {
+        cerr << "Unknown index: " << engine << endl;
+        return 1;
+    }
+
+    vector<DataVector> points = readCSVParallel(argv[2], params.threads);
+    if (points.empty())
+    {
+        cerr << "No points in " << argv[2] << endl;
+        return 1;
+    }
+    int dim = points[0].getDimension();
+    if (kind == ENGINE_AUTO)
+    {
+        kind = chooseEngine(profileDataset(points), ENGINE_AUTO, cerr);
+    }
+    unique_ptr<TreeIndex> built(makeEngine(kind, params));
+
+    CachedIndex index(*built, params);
+    if (!admitBuild(index.estimateMemory(points.size(), dim), params))
+    {
+        return 1;
+    }
+    auto start = high_resolution_clock::now();
+    index.maketree(points);
+    auto stop = high_resolution_clock::now();
+    cerr << "Indexed " << points.size() << " points of dimension " << dim << " in "
+         << duration_cast<milliseconds>(stop - start).count() << " milliseconds" << endl;
+
+    // a client that disconnects early must not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+    QueryBatcher batcher(index, params.batchSize, params.batchWait);
+
+    if (argc <= 4)
+    {
+        serveConnection(STDIN_FILENO, STDOUT_FILENO, batcher, dim, points.size(), false);
+        return 0;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, argv[4], sizeof(address.sun_path) - 1);
+    unlink(address.sun_path);
+    if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 64) < 0)
+    {
+        cerr << "Cannot listen on " << argv[4] << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    cerr << "Listening on " << argv[4] << endl;
+
+    // clients still being read hold the batcher, so main waits for them before it is destroyed
+    mutex clientsLock;
+    condition_variable clientsDone;
+    set<int> clients;
+    while (true)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            int error = errno;
+            if (error == EINTR || error == ECONNABORTED)
+                continue;
+            cerr << "accept: " << strerror(error) << endl;
+            if (error == EBADF || error == EINVAL || error == ENOTSOCK || error == EOPNOTSUPP || error == EFAULT)
+                break;
+            // out of descriptors or memory: back off and keep serving the clients already connected
+            this_thread::sleep_for(milliseconds(100));
+            continue;
+        }
+        int indexed = points.size();
+        {
+            lock_guard<mutex> guard(clientsLock);
+            clients.insert(client);
+        }
+        thread([&, client, indexed]() {
+            serveConnection(client, client, batcher, dim, indexed, true);
+            lock_guard<mutex> guard(clientsLock);
+            clients.erase(client);
+            clientsDone.notify_all();
+        }).detach();
+    }
+    close(listener);
+
+    // end the open connections; their pending replies are still answered as the batcher drains
+    unique_lock<mutex> guard(clientsLock);
+    for (int client : clients)
+    {
+        shutdown(client, SHUT_RD);
+    }
+    clientsDone.wait(guard, [&clients]() { return clients.empty(); });
+    return 0;
+}